@@ -0,0 +1,37 @@
+#include "alloc_check.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef CHECK_FRAME_ALLOCATIONS
+
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size){
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    
+    if (void *const p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept{
+    std::free(p);
+}
+
+size_t allocationCount(){
+    return allocations.load(std::memory_order_relaxed);
+}
+
+#else
+
+size_t allocationCount(){
+    return 0;
+}
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef alloc_check_hpp
+#define alloc_check_hpp
+
+#include <cstddef>
+
+// -DCHECK_FRAME_ALLOCATIONS を付けてビルドしたときだけ operator new の呼び出し回数を数える
+size_t allocationCount();
+
+#endif /* alloc_check_hpp */
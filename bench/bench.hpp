@@ -0,0 +1,40 @@
+#ifndef bench_hpp
+#define bench_hpp
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+// f(i) を iterations 回呼ぶ時間を runs 回測り, 一番速かった回の 1 回あたりの時間 [ns] を返す
+template <typename F>
+double measure(long iterations, F f, int runs = 5){
+    double best(0.0);
+    
+    for (int r = 0; r < runs; ++r) {
+        const auto start(std::chrono::steady_clock::now());
+        for (long i = 0; i < iterations; ++i) {
+            f(i);
+        }
+        const std::chrono::duration<double, std::nano> elapsed(std::chrono::steady_clock::now() - start);
+        
+        const double t(elapsed.count() / static_cast<double>(iterations));
+        if (r == 0 || t < best) {
+            best = t;
+        }
+    }
+    
+    return best;
+}
+
+// v を計算したことにして最適化で消されないようにする
+template <typename T>
+inline void keep(const T &v){
+    asm volatile("" : : "r"(&v) : "memory");
+}
+
+// 一行に名前と 1 回あたりの時間を出力する
+inline void report(const char *name, double ns, const char *note = ""){
+    std::printf("%-40s %12.2f ns %s\n", name, ns, note);
+}
+
+#endif /* bench_hpp */
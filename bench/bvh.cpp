@@ -0,0 +1,121 @@
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "bench.hpp"
+#include "../class/Matrix.h"
+#include "../class/Ray.h"
+#include "../class/ThreadPool.h"
+#include "../class/TriangleBVH.h"
+#include "../class/Picker.h"
+
+// 細かい球の三角形の BVH を作る時間と, 光線を 1 本ずつ辿る場合と 4 本まとめて辿る場合の光線 1 本あたりの時間を比べる
+// 二つの辿り方の結果が同じことと, 方向の成分が 0 で箱の面の上から出る光線が箱の縁の三角形に当たることを確かめる
+int main(){
+    static constexpr int slices(512), stacks(256);
+    
+    std::vector<Object::Vertex> vertex;
+    for (int j = 0; j <= stacks; ++j) {
+        const float t(static_cast<float>(j) / stacks), y(cos(3.141593f * t)), r(sin(3.141593f * t));
+        for (int i = 0; i <= slices; ++i) {
+            const float s(static_cast<float>(i) / slices), z(r * cos(2.0f * 3.141593f * s)), x(r * sin(2.0f * 3.141593f * s));
+            const Object::Vertex v = { x, y, z, x, y, z };
+            vertex.emplace_back(v);
+        }
+    }
+    std::vector<GLuint> index;
+    for (int j = 0; j < stacks; ++j) {
+        for (int i = 0; i < slices; ++i) {
+            const GLuint k0((slices + 1) * j + i), k1(k0 + 1), k2(k1 + slices), k3(k2 + 1);
+            const GLuint quad[] = { k0, k2, k3, k0, k3, k1 };
+            index.insert(index.end(), quad, quad + 6);
+        }
+    }
+    const GLsizei indexcount(static_cast<GLsizei>(index.size()));
+    
+    ThreadPool pool;
+    char note[64];
+    
+    std::snprintf(note, sizeof note, "%d triangles", indexcount / 3);
+    report("build, one thread", measure(3, [&](long){
+        const TriangleBVH bvh(vertex.data(), indexcount, index.data());
+        keep(bvh);
+    }), note);
+    report("build, thread pool", measure(3, [&](long){
+        const TriangleBVH bvh(vertex.data(), indexcount, index.data(), &pool);
+        keep(bvh);
+    }), note);
+    
+    // 二つ並べた球を 256 x 256 の光線で見る. 半分ほどは外れる
+    const TriangleBVH sphere(vertex.data(), indexcount, index.data(), &pool);
+    Picker picker;
+    picker.add(sphere, Matrix::translate(-1.1f, 0.0f, 0.0f));
+    picker.add(sphere, Matrix::translate(1.1f, 0.0f, 0.0f));
+    picker.build();
+    
+    const Matrix projection(Matrix::perspective(1.0f, 1.0f, 1.0f, 20.0f));
+    const Matrix view(Matrix::lookat(0.0f, 0.0f, 6.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f));
+    static constexpr int grid(256);
+    std::vector<Ray> rays;
+    for (int j = 0; j < grid; ++j) {
+        for (int i = 0; i < grid; ++i) {
+            rays.emplace_back(Ray::fromCursor(projection, view, (i + 0.5f) * 2.0f / grid - 1.0f, (j + 0.5f) * 2.0f / grid - 1.0f));
+        }
+    }
+    
+    std::vector<Hit> single(rays.size()), packet(rays.size());
+    const double one(measure(1, [&](long){
+        for (size_t i = 0; i < rays.size(); ++i) {
+            picker.pick(rays[i], single[i]);
+        }
+    }) / rays.size());
+    std::snprintf(note, sizeof note, "%.2f M rays/s", 1.0e3 / one);
+    report("pick, one ray at a time", one, note);
+    
+    const double four(measure(1, [&](long){
+        for (size_t i = 0; i < rays.size(); i += 4) {
+            picker.pick(&rays[i], &packet[i]);
+        }
+    }) / rays.size());
+    std::snprintf(note, sizeof note, "%.2f M rays/s", 1.0e3 / four);
+    report("pick, packets of 4 rays", four, note);
+    
+    // 動かしていなければ作り直さない
+    report("picker build, unchanged", measure(1000, [&](long){
+        picker.setModel(0, Matrix::translate(-1.1f, 0.0f, 0.0f));
+        picker.build();
+    }));
+    report("picker build, moved", measure(1000, [&](long i){
+        picker.setModel(0, Matrix::translate(-1.1f, 0.001f * (i & 1), 0.0f));
+        picker.build();
+    }));
+    
+    for (size_t i = 0; i < rays.size(); ++i) {
+        if (single[i].instance != packet[i].instance || single[i].triangle != packet[i].triangle) {
+            std::printf("ray %zu: one ray hit %d/%d, the packet hit %d/%d\n",
+                        i, single[i].instance, single[i].triangle, packet[i].instance, packet[i].triangle);
+            return 1;
+        }
+    }
+    
+    // z = 0 の面に置いた 2 x 2 の四角形の左の縁を真上から突く. 方向の x と y が 0 で, 原点の x が箱の面の上にある
+    const Object::Vertex corner[4] = {
+        { -1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f }, { 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f },
+        { 1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f }, { -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f }
+    };
+    static constexpr GLuint quad[] = { 0, 1, 2, 0, 2, 3 };
+    const TriangleBVH square(corner, 6, quad);
+    
+    const Ray edge[4] = {
+        { { -1.0f, 0.3f, 5.0f }, { 0.0f, 0.0f, -1.0f } }, { { -1.0f, -0.3f, 5.0f }, { 0.0f, 0.0f, -1.0f } },
+        { { -1.0f, 0.6f, 5.0f }, { 0.0f, 0.0f, -1.0f } }, { { -1.0f, -0.6f, 5.0f }, { 0.0f, 0.0f, -1.0f } }
+    };
+    Hit hit(Hit::none()), hits[4] = { Hit::none(), Hit::none(), Hit::none(), Hit::none() };
+    const bool hitOne(square.intersect(edge[0], hit));
+    const int hitFour(square.intersect(edge, hits));
+    if (!hitOne || hitFour != 0xf) {
+        std::printf("a ray along the edge of a box missed (one ray %d, packet mask %x)\n", hitOne, hitFour);
+        return 1;
+    }
+    
+    return 0;
+}
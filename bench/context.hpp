@@ -0,0 +1,28 @@
+#ifndef context_hpp
+#define context_hpp
+
+#include <cstdlib>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include "../log.hpp"
+
+// GL を使うベンチマークのために, main() と同じ版のコンテキストを見えないウィンドウに作る準備をする
+// この後で Window を作り, 垂直同期を待たないようにしてから測る
+inline bool initContext(){
+    if (glfwInit() == GL_FALSE) {
+        logMessage(LOG_FATAL, LOG_WINDOW, "cant initialize GLFW");
+        return false;
+    }
+    
+    atexit(glfwTerminate);
+    
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    
+    return true;
+}
+
+#endif /* context_hpp */
@@ -0,0 +1,237 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "bench.hpp"
+#include "context.hpp"
+#include "../alloc_check.hpp"
+#include "../load_window.hpp"
+#include "../pointcloud.hpp"
+#include "../class/Window.h"
+#include "../class/Program.h"
+#include "../class/Uniform.h"
+#include "../class/Material.h"
+#include "../class/SolidShapeIndex.h"
+#include "../class/Skeleton.h"
+#include "../class/Animation.h"
+#include "../class/SkinnedShape.h"
+#include "../class/ThreadPool.h"
+#include "../class/FrameArena.h"
+#include "../class/TriangleBVH.h"
+#include "../class/Picker.h"
+#include "../class/Ray.h"
+#include "../class/ParticleSimulator.h"
+#include "../class/ParticleSystem.h"
+#include "../class/PointCloud.h"
+
+// main.cpp のフレームでする仕事を一通り動かし, 立ち上がりのあとのフレームで operator new が呼ばれないことを確かめる
+// -DCHECK_FRAME_ALLOCATIONS を付けてビルドした alloc_check.o とリンクする (make bench はそうする)
+int main(){
+    {
+        const size_t before(allocationCount());
+        int *volatile p(new int(0));
+        delete p;
+        if (allocationCount() == before) {
+            std::printf("operator new is not counted: rebuild with -DCHECK_FRAME_ALLOCATIONS (make clean && make bench)\n");
+            return 1;
+        }
+    }
+    
+    if (!initContext()) {
+        return 1;
+    }
+    
+    Window window(256, 256, "frameloop");
+    window.setPresentMode(FramePacer::UNLOCKED);
+    
+    Program program(loadProgram("point.vert", "point.frag"));
+    const Program::Variable<Matrix> modelviewLoc(program.uniform<Matrix>("modelview"));
+    const Program::Variable<Matrix> projectionLoc(program.uniform<Matrix>("projection"));
+    program.bind<Material>("Material", 0);
+    
+    Program skinProgram(loadProgram("skin.vert", "point.frag"));
+    const Program::Variable<Matrix> skinModelviewLoc(skinProgram.uniform<Matrix>("modelview"));
+    const Program::Variable<Matrix> skinProjectionLoc(skinProgram.uniform<Matrix>("projection"));
+    skinProgram.bind<Material>("Material", 0);
+    skinProgram.bind<SkinnedShape::Palette>("Palette", 1);
+    
+    static constexpr Material color[] = {
+        { 0.6f, 0.6f, 0.2f, 0.6f, 0.6f, 0.2f, 0.3f, 0.3f, 0.3f, 30.0f },
+        { 0.1f, 0.1f, 0.5f, 0.1f, 0.1f, 0.5f, 0.4f, 0.4f, 0.4f, 60.0f }
+    };
+    const Uniform<Material> material(color, 2);
+    
+    // 球
+    static constexpr int slices(16), stacks(8);
+    std::vector<Object::Vertex> sphereVertex;
+    for (int j = 0; j <= stacks; ++j) {
+        const float t(static_cast<float>(j) / stacks), y(cos(3.141593f * t)), r(sin(3.141593f * t));
+        for (int i = 0; i <= slices; ++i) {
+            const float s(static_cast<float>(i) / slices), z(r * cos(2.0f * 3.141593f * s)), x(r * sin(2.0f * 3.141593f * s));
+            const Object::Vertex v = { x, y, z, x, y, z };
+            sphereVertex.emplace_back(v);
+        }
+    }
+    std::vector<GLuint> sphereIndex;
+    for (int j = 0; j < stacks; ++j) {
+        for (int i = 0; i < slices; ++i) {
+            const GLuint k0((slices + 1) * j + i), k1(k0 + 1), k2(k1 + slices), k3(k2 + 1);
+            sphereIndex.insert(sphereIndex.end(), { k0, k2, k3, k0, k3, k1 });
+        }
+    }
+    const SolidShapeIndex sphere(3, static_cast<GLsizei>(sphereVertex.size()), sphereVertex.data(),
+        static_cast<GLsizei>(sphereIndex.size()), sphereIndex.data());
+    
+    // 二つの関節で曲がる円柱
+    static constexpr int joints(2);
+    std::vector<SkinnedShape::Vertex> tubeVertex;
+    for (int j = 0; j <= stacks; ++j) {
+        const float y(2.0f * j / stacks - 1.0f);
+        const GLubyte w1(static_cast<GLubyte>((y + 1.0f) * 127.5f));
+        for (int i = 0; i <= slices; ++i) {
+            const float s(static_cast<float>(i) / slices), z(cos(2.0f * 3.141593f * s)), x(sin(2.0f * 3.141593f * s));
+            const SkinnedShape::Vertex v = { { 0.3f * x, y, 0.3f * z }, { x, 0.0f, z }, { 0, 1, 0, 0 }, { static_cast<GLubyte>(255 - w1), w1, 0, 0 } };
+            tubeVertex.emplace_back(v);
+        }
+    }
+    const SkinnedShape tube(static_cast<GLsizei>(tubeVertex.size()), tubeVertex.data(),
+        static_cast<GLsizei>(sphereIndex.size()), sphereIndex.data());
+    
+    static constexpr int parent[joints] = { -1, 0 };
+    const Matrix inverseBind[joints] = { Matrix::translate(0.0f, 1.0f, 0.0f), Matrix::translate(0.0f, -1.0f, 0.0f) };
+    static constexpr GLfloat keyTime[] = { 0.0f, 1.0f };
+    static constexpr GLfloat keyTranslation[2][joints][3] = { { { 0.0f, -1.0f, 0.0f }, { 0.0f, 2.0f, 0.0f } }, { { 0.0f, -1.0f, 0.0f }, { 0.0f, 2.0f, 0.0f } } };
+    const Quaternion keyRotation[2][joints] = {
+        { Quaternion::rotate(0.0f, 0.0f, 0.0f, 1.0f), Quaternion::rotate(-0.4f, 0.0f, 0.0f, 1.0f) },
+        { Quaternion::rotate(0.0f, 0.0f, 0.0f, 1.0f), Quaternion::rotate(0.4f, 0.0f, 0.0f, 1.0f) }
+    };
+    const Skeleton skeleton(joints, parent, inverseBind);
+    const Animation animation(joints, 2, keyTime, keyTranslation[0][0], keyRotation[0]);
+    SkinnedShape::Palette palette;
+    const Uniform<SkinnedShape::Palette> paletteBuffer(&palette);
+    
+    ThreadPool pool;
+    
+    const TriangleBVH sphereBVH(sphereVertex.data(), static_cast<GLsizei>(sphereIndex.size()), sphereIndex.data(), &pool);
+    Picker picker;
+    picker.add(sphereBVH, Matrix::identity());
+    picker.add(sphereBVH, Matrix::translate(0.0f, 0.0f, 3.0f));
+    
+    static constexpr ParticleParameters particleParameters = {
+        { { { -1.5f, 1.0f, 0.0f }, 2.0f }, { { 1.5f, 1.0f, 0.0f }, 3.0f } }, 2, { 0.0f, -2.0f, 0.0f }, 0.2f, 3.0f
+    };
+    static constexpr std::array<GLfloat, 3> particleColor = { 1.0f, 0.4f, 0.1f };
+    ParticleSystem gpuParticles(10000, particleParameters);
+    ParticleSystem cpuParticles(10000, particleParameters);
+    ParticleSimulator simulator(10000, particleParameters);
+    
+    // 一辺 1 の立方体に散らばった点の小さな八分木
+    char directory[] = "/tmp/frameloopXXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        std::printf("cant create a temporary directory\n");
+        return 1;
+    }
+    const std::string input(std::string(directory) + "/input.bin");
+    {
+        std::ofstream file(input, std::ios::binary);
+        srand(1);
+        for (int i = 0; i < 200000; ++i) {
+            PointCloud::Point p = { { static_cast<GLfloat>(rand()) / RAND_MAX, static_cast<GLfloat>(rand()) / RAND_MAX,
+                static_cast<GLfloat>(rand()) / RAND_MAX }, { 255, 128, 0, 255 } };
+            file.write(reinterpret_cast<const char *>(&p), sizeof p);
+        }
+    }
+    if (!buildPointCloud(input.c_str(), directory, 16384)) {
+        return 1;
+    }
+    PointCloud cloud(directory);
+    
+    const Matrix view(Matrix::lookat(3.0f, 4.0f, 5.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f));
+    const Matrix projection(Matrix::perspective(1.0f, 1.0f, 1.0f, 10.0f));
+    
+    static constexpr int warmup(60), frames(300);
+    size_t allocations(0);
+    int firstFrame(-1);
+    
+    for (int frame = 0; frame < frames; ++frame) {
+        const size_t start(allocationCount());
+        FrameArena::beginFrame();
+        
+        const GLfloat angle(0.01f * frame);
+        const Matrix model(Matrix::rotate(angle, 0.0f, 1.0f, 0.0f));
+        const Matrix modelview(view * model);
+        
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        
+        program.use();
+        program.set(projectionLoc, projection);
+        program.set(modelviewLoc, modelview);
+        material.select(0, frame & 1);
+        sphere.draw();
+        
+        // 球を指す
+        picker.setModel(0, model);
+        picker.setModel(1, model * Matrix::translate(0.0f, 0.0f, 3.0f));
+        picker.build();
+        Hit hit;
+        picker.pick(Ray::fromCursor(projection, view, 0.0f, 0.0f), hit);
+        const Ray rays[4] = {
+            Ray::fromCursor(projection, view, -0.01f, -0.01f), Ray::fromCursor(projection, view, 0.01f, -0.01f),
+            Ray::fromCursor(projection, view, -0.01f, 0.01f), Ray::fromCursor(projection, view, 0.01f, 0.01f)
+        };
+        Hit hits[4];
+        picker.pick(rays, hits);
+        
+        // 両方の方法で円柱を変形する
+        std::vector<Matrix, ArenaAllocator<Matrix>> transform(skeleton.size());
+        animation.sample(std::fmod(angle, 1.0f), transform.data());
+        skeleton.pose(transform.data(), palette.joint);
+        tube.draw(palette.joint, pool);
+        
+        skinProgram.use();
+        skinProgram.set(skinProjectionLoc, projection);
+        skinProgram.set(skinModelviewLoc, modelview);
+        paletteBuffer.set(&palette);
+        paletteBuffer.select(1);
+        tube.draw();
+        
+        gpuParticles.step(particleParameters, 1.0f / 60.0f);
+        gpuParticles.draw(projection, view, particleParameters, 40.0f, particleColor);
+        cpuParticles.step(particleParameters, 1.0f / 60.0f, simulator, pool);
+        cpuParticles.draw(projection, view, particleParameters, 40.0f, particleColor);
+        
+        cloud.update(projection, modelview, 256.0f);
+        cloud.draw(projection, modelview, 256.0f);
+        
+        window.swapBuffers();
+        
+        // 点群の読み込みが終わるまでは立ち上がりとみなす
+        if (frame == warmup - 1) {
+            glFinish();
+            usleep(100000);
+        }
+        
+        if (frame >= warmup && allocationCount() != start) {
+            allocations += allocationCount() - start;
+            if (firstFrame < 0) {
+                firstFrame = frame;
+            }
+        }
+    }
+    
+    unlink(input.c_str());
+    unlink((std::string(directory) + "/hierarchy.bin").c_str());
+    unlink((std::string(directory) + "/points.bin").c_str());
+    rmdir(directory);
+    
+    std::printf("%d frames after warm-up: %zu heap allocations", frames - warmup, allocations);
+    if (firstFrame >= 0) {
+        std::printf(" (first in frame %d)", firstFrame);
+    }
+    std::printf(", render thread arena peak %zu bytes\n", FrameArena::local().getPeak());
+    
+    return allocations == 0 ? 0 : 1;
+}
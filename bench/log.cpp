@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+#include "bench.hpp"
+#include "../log.hpp"
+#include "../class/Matrix.h"
+
+// logMessage() を呼ぶ側の時間を fprintf() と比べ, フレームに 20 個書いてもフレームの時間がほとんど変わらないことを確かめる
+// 出力は /dev/null に向けるので, 測るのはドレインスレッドとの取り合いも含めた呼び出し側の時間になる
+namespace {
+    // 輪が溢れて捨てない数ずつ, 出力し終えてから測る
+    template <typename F>
+    double measureLog(F f){
+        double best(0.0);
+        for (int r = 0; r < 5; ++r) {
+            flushLog();
+            const double t(measure(400, f, 1));
+            best = r == 0 ? t : std::min(best, t);
+        }
+        return best;
+    }
+    
+    // 1 フレームの仕事の代わりに行列の積を繰り返す
+    double frame(int messages, int index){
+        Matrix m(Matrix::rotate(0.001f * index, 0.0f, 1.0f, 0.0f));
+        for (int i = 0; i < 100000; ++i) {
+            m = Matrix(m * Matrix::translate(0.0f, 0.0f, 1.0e-6f));
+            if (i % (100000 / 20) == 0 && i / (100000 / 20) < messages) {
+                logMessage(LOG_INFO, LOG_GENERAL, "frame {}: step {} at {}", index, i, m.data()[14]);
+            }
+        }
+        keep(m);
+        return m.data()[14];
+    }
+}
+
+int main(){
+    // 書き出しを捨てる. 最後に戻す
+    std::fflush(stderr);
+    const int saved(dup(fileno(stderr)));
+    if (saved < 0 || std::freopen("/dev/null", "w", stderr) == NULL) {
+        return 1;
+    }
+    
+    const double disabled(measureLog([](long i){
+        logMessage(LOG_DEBUG, LOG_GENERAL, "frame {}: step {} at {}", i, 3, 0.5);
+    }));
+    const double enabled(measureLog([](long i){
+        logMessage(LOG_INFO, LOG_GENERAL, "frame {}: step {} at {}", i, 3, 0.5);
+    }));
+    const double strings(measureLog([](long i){
+        logMessage(LOG_INFO, LOG_RESOURCE, "cant open point file: {} ({})", "/tmp/points/input.bin", i);
+    }));
+    const double printed(measureLog([](long i){
+        std::fprintf(stderr, "[%11.6f] INFO  general: frame %ld: step %d at %g\n", 1.0, i, 3, 0.5);
+    }));
+    
+    const double quiet(measure(50, [](long i){ frame(0, static_cast<int>(i)); }));
+    const double logging(measure(50, [](long i){ frame(20, static_cast<int>(i)); }));
+    
+    flushLog();
+    std::fflush(stderr);
+    dup2(saved, fileno(stderr));
+    close(saved);
+    
+    report("logMessage below the level", disabled);
+    report("logMessage, 3 numbers", enabled);
+    report("logMessage, a string and a number", strings);
+    report("fprintf to stderr, 3 numbers", printed);
+    
+    char note[64];
+    std::snprintf(note, sizeof note, "%.3f ms", quiet * 1.0e-6);
+    report("frame without logging", quiet, note);
+    std::snprintf(note, sizeof note, "%.3f ms, %+.2f%%", logging * 1.0e-6, (logging / quiet - 1.0) * 100.0);
+    report("frame with 20 messages", logging, note);
+    
+    return 0;
+}
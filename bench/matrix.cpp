@@ -0,0 +1,66 @@
+#include <cstdlib>
+#include <vector>
+#include "bench.hpp"
+#include "../class/Matrix.h"
+#include "../class/Vector.h"
+
+// 行列の積の連鎖を式のまま一度に評価する場合と, 二つずつ一時的な行列に求める場合を比べる
+int main(){
+    static constexpr int count(1024);
+    static constexpr long iterations(1 << 20);
+    
+    std::vector<Matrix> a, b, c, d;
+    std::vector<Vector> v;
+    srand(1);
+    for (int i = 0; i < count; ++i) {
+        const GLfloat x(static_cast<GLfloat>(rand()) / RAND_MAX);
+        a.emplace_back(Matrix::lookat(x, 4.0f, 5.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f));
+        b.emplace_back(Matrix::translate(x, 1.0f - x, 0.5f));
+        c.emplace_back(Matrix::rotate(x, 0.0f, 1.0f, 0.0f));
+        d.emplace_back(Matrix::scale(x, x, 1.0f));
+        v.push_back(Vector{ x, 1.0f, -x, 1.0f });
+    }
+    
+    Matrix out;
+    
+    report("4 matrices, fused", measure(iterations, [&](long i){
+        const int k(static_cast<int>(i) & (count - 1));
+        out = a[k] * b[k] * c[k] * d[k];
+        keep(out);
+    }));
+    
+    report("4 matrices, pairwise", measure(iterations, [&](long i){
+        const int k(static_cast<int>(i) & (count - 1));
+        const Matrix ab(a[k] * b[k]);
+        const Matrix abc(ab * c[k]);
+        out = abc * d[k];
+        keep(out);
+    }));
+    
+    Vector w;
+    
+    report("4 matrices times vector, fused", measure(iterations, [&](long i){
+        const int k(static_cast<int>(i) & (count - 1));
+        w = a[k] * b[k] * c[k] * d[k] * v[k];
+        keep(w);
+    }));
+    
+    report("4 matrices times vector, pairwise", measure(iterations, [&](long i){
+        const int k(static_cast<int>(i) & (count - 1));
+        const Matrix ab(a[k] * b[k]);
+        const Matrix abc(ab * c[k]);
+        const Matrix abcd(abc * d[k]);
+        w = abcd * v[k];
+        keep(w);
+    }));
+    
+    // 保存した式が一時的な行列を指したままになっていないか確かめる
+    const auto e(Matrix::translate(1.0f, 2.0f, 3.0f) * Matrix::scale(2.0f, 2.0f, 2.0f));
+    const Matrix m(e);
+    if (m.data()[0] != 2.0f || m.data()[12] != 1.0f || m.data()[14] != 3.0f) {
+        std::printf("stored matrix expression evaluated incorrectly\n");
+        return 1;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "bench.hpp"
+#include "context.hpp"
+#include "../meshcodec.hpp"
+#include "../class/Window.h"
+#include "../class/Object.h"
+
+// 球の頂点と指標を圧縮と展開する速さと圧縮率, 圧縮したものと生のものから Object を作る時間を比べる
+// 展開した結果が元と同じことと, 壊れたデータから作った Object が描かれないことも確かめる
+int main(){
+    static constexpr int slices(512), stacks(256);
+    
+    std::vector<Object::Vertex> vertex;
+    for (int j = 0; j <= stacks; ++j) {
+        const float t(static_cast<float>(j) / stacks), y(cos(3.141593f * t)), r(sin(3.141593f * t));
+        for (int i = 0; i <= slices; ++i) {
+            const float s(static_cast<float>(i) / slices), z(r * cos(2.0f * 3.141593f * s)), x(r * sin(2.0f * 3.141593f * s));
+            const Object::Vertex v = { x, y, z, x, y, z };
+            vertex.emplace_back(v);
+        }
+    }
+    std::vector<GLuint> index;
+    for (int j = 0; j < stacks; ++j) {
+        for (int i = 0; i < slices; ++i) {
+            const GLuint k0((slices + 1) * j + i), k1(k0 + 1), k2(k1 + slices), k3(k2 + 1);
+            const GLuint quad[] = { k0, k2, k3, k0, k3, k1 };
+            index.insert(index.end(), quad, quad + 6);
+        }
+    }
+    
+    EncodedMesh mesh;
+    mesh.vertexcount = static_cast<GLsizei>(vertex.size());
+    mesh.indexcount = static_cast<GLsizei>(index.size());
+    const size_t vertexBytes(vertex.size() * sizeof(Object::Vertex)), indexBytes(index.size() * sizeof(GLuint));
+    char note[64];
+    
+    const double encodeVertex(measure(10, [&](long){
+        encodeVertexBuffer(vertex.data(), mesh.vertexcount, sizeof(Object::Vertex), mesh.vertex);
+    }));
+    std::snprintf(note, sizeof note, "%.0f MB/s, %zu -> %zu bytes", vertexBytes / encodeVertex * 1.0e3, vertexBytes, mesh.vertex.size());
+    report("encode vertices", encodeVertex, note);
+    
+    const double encodeIndex(measure(10, [&](long){
+        encodeIndexBuffer(index.data(), mesh.indexcount, mesh.index);
+    }));
+    std::snprintf(note, sizeof note, "%.0f MB/s, %zu -> %zu bytes", indexBytes / encodeIndex * 1.0e3, indexBytes, mesh.index.size());
+    report("encode indices", encodeIndex, note);
+    
+    std::vector<Object::Vertex> decodedVertex(vertex.size());
+    std::vector<GLuint> decodedIndex(index.size());
+    bool decoded(true);
+    
+    const double decodeVertex(measure(10, [&](long){
+        decoded = decodeVertexBuffer(mesh.vertex.data(), mesh.vertex.size(), decodedVertex.data(), mesh.vertexcount, sizeof(Object::Vertex)) && decoded;
+    }));
+    std::snprintf(note, sizeof note, "%.0f MB/s", vertexBytes / decodeVertex * 1.0e3);
+    report("decode vertices", decodeVertex, note);
+    
+    const double decodeIndex(measure(10, [&](long){
+        decoded = decodeIndexBuffer(mesh.index.data(), mesh.index.size(), decodedIndex.data(), mesh.indexcount) && decoded;
+    }));
+    std::snprintf(note, sizeof note, "%.0f MB/s", indexBytes / decodeIndex * 1.0e3);
+    report("decode indices", decodeIndex, note);
+    
+    if (!decoded || std::memcmp(decodedVertex.data(), vertex.data(), vertexBytes) != 0 || decodedIndex != index) {
+        std::printf("decoding did not give back the encoded mesh\n");
+        return 1;
+    }
+    
+    if (!initContext()) {
+        return 1;
+    }
+    
+    Window window(256, 256, "meshcodec");
+    window.setPresentMode(FramePacer::UNLOCKED);
+    
+    const double raw(measure(10, [&](long){
+        const Object object(3, mesh.vertexcount, vertex.data(), mesh.indexcount, index.data());
+        glFinish();
+    }));
+    report("object from raw arrays", raw);
+    
+    const double compressed(measure(10, [&](long){
+        const Object object(3, mesh);
+        glFinish();
+    }));
+    report("object decoded into mapped buffers", compressed);
+    
+    // 指標の途中で切れたデータ
+    EncodedMesh broken(mesh);
+    broken.index.resize(broken.index.size() / 2);
+    if (Object(3, broken).valid()) {
+        std::printf("an object was drawable after its indices failed to decode\n");
+        return 1;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "bench.hpp"
+#include "context.hpp"
+#include "../class/Window.h"
+#include "../class/ParticleSimulator.h"
+#include "../class/ParticleSystem.h"
+#include "../class/ThreadPool.h"
+
+// 粒子を Transform Feedback で動かす場合と CPU で動かしてバッファに書く場合の 1 ミリ秒あたりの粒子の数を比べ,
+// 同じ手順で進めた二つの結果が一致するか確かめる
+int main(){
+    if (!initContext()) {
+        return 1;
+    }
+    
+    Window window(256, 256, "particles");
+    window.setPresentMode(FramePacer::UNLOCKED);
+    
+    static constexpr ParticleParameters parameters = {
+        { { { -1.5f, 1.0f, 0.0f }, 2.0f }, { { 1.5f, 1.0f, 0.0f }, 3.0f } }, 2, { 0.0f, -2.0f, 0.0f }, 0.2f, 3.0f
+    };
+    static constexpr GLfloat dt(1.0f / 60.0f);
+    
+    ThreadPool pool;
+    char note[64];
+    
+    // 比べる. 経過時間の足し算は両方で同じなので生まれ直す粒子はそろい, 位置と速度には丸めの差だけが残る
+    {
+        static constexpr GLsizei count(10000);
+        static constexpr int steps(240);
+        
+        ParticleSystem gpu(count, parameters);
+        ParticleSimulator cpu(count, parameters);
+        for (int i = 0; i < steps; ++i) {
+            gpu.step(parameters, dt);
+            cpu.step(parameters, dt, i, pool);
+        }
+        
+        std::vector<GLfloat> expected(static_cast<size_t>(count) * 8), actual(expected.size());
+        cpu.get(0, count, expected.data());
+        gpu.read(actual.data());
+        
+        GLfloat error(0.0f);
+        size_t worst(0);
+        for (size_t i = 0; i < expected.size(); ++i) {
+            const GLfloat e(std::fabs(expected[i] - actual[i]));
+            if (!(e <= error)) {
+                error = e;
+                worst = i;
+            }
+        }
+        
+        std::printf("%d particles after %d steps: largest difference %g (particle %zu, component %zu)\n",
+                    count, steps, error, worst / 8, worst % 8);
+        if (!(error < 1.0e-3f)) {
+            std::printf("the GPU path does not match ParticleSimulator\n");
+            return 1;
+        }
+    }
+    
+    static constexpr GLsizei count(1 << 20);
+    
+    ParticleSimulator simulator(count, parameters);
+    const double simulate(measure(20, [&](long i){
+        simulator.step(parameters, dt, static_cast<int>(i), pool);
+    }));
+    std::snprintf(note, sizeof note, "%.0f particles/ms", count / simulate * 1.0e6);
+    report("cpu simulation", simulate, note);
+    
+    ParticleSystem cpuSystem(count, parameters);
+    const double cpu(measure(20, [&](long){
+        cpuSystem.step(parameters, dt, simulator, pool);
+        glFinish();
+    }));
+    std::snprintf(note, sizeof note, "%.0f particles/ms", count / cpu * 1.0e6);
+    report("cpu simulation + upload", cpu, note);
+    
+    ParticleSystem gpuSystem(count, parameters);
+    const double gpu(measure(20, [&](long){
+        gpuSystem.step(parameters, dt);
+        glFinish();
+    }));
+    std::snprintf(note, sizeof note, "%.0f particles/ms", count / gpu * 1.0e6);
+    report("transform feedback", gpu, note);
+    
+    return 0;
+}
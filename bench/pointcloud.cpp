@@ -0,0 +1,118 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include "bench.hpp"
+#include "context.hpp"
+#include "../pointcloud.hpp"
+#include "../class/Window.h"
+#include "../class/FrameArena.h"
+#include "../class/PointCloud.h"
+
+// 点の数を変えた点群で, 止まった視点と回る視点の 1 フレームの時間 (update() と draw() と glFinish()) を測る
+// 回る視点では描く点の上限を点の数の 1/8 にして, 読み込みの取り消しと GPU から捨てる処理も通す
+// 最後に節点の点がファイルの外を指す八分木を読ませ, 読み込みを断ることを確かめる
+int main(){
+    if (!initContext()) {
+        return 1;
+    }
+    
+    Window window(256, 256, "pointcloud");
+    window.setPresentMode(FramePacer::UNLOCKED);
+    
+    const Matrix view(Matrix::lookat(1.5f, 2.0f, 2.5f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f));
+    const Matrix projection(Matrix::perspective(1.0f, 1.0f, 0.1f, 10.0f));
+    const Matrix center(Matrix::translate(-0.5f, -0.5f, -0.5f));
+    
+    char directory[] = "/tmp/pointcloudXXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        std::printf("cant create a temporary directory\n");
+        return 1;
+    }
+    const std::string input(std::string(directory) + "/input.bin");
+    const std::string hierarchy(std::string(directory) + "/hierarchy.bin");
+    const std::string points(std::string(directory) + "/points.bin");
+    
+    static constexpr int sizes[] = { 250000, 1000000, 4000000 };
+    char name[64], note[64];
+    
+    for (int size : sizes) {
+        {
+            std::ofstream file(input, std::ios::binary);
+            srand(1);
+            for (int i = 0; i < size; ++i) {
+                PointCloud::Point p = { { static_cast<GLfloat>(rand()) / RAND_MAX, static_cast<GLfloat>(rand()) / RAND_MAX,
+                    static_cast<GLfloat>(rand()) / RAND_MAX }, { 255, 128, 0, 255 } };
+                file.write(reinterpret_cast<const char *>(&p), sizeof p);
+            }
+        }
+        if (!buildPointCloud(input.c_str(), directory, 16384)) {
+            return 1;
+        }
+        
+        PointCloud cloud(directory);
+        if (cloud.root() == NULL) {
+            return 1;
+        }
+        
+        // 止まった視点. 読み込みが終わってから測る
+        const Matrix modelview(view * center);
+        for (int i = 0; i < 200; ++i) {
+            FrameArena::beginFrame();
+            cloud.update(projection, modelview, 256.0f);
+            window.swapBuffers();
+            if (i % 20 == 0) {
+                glFinish();
+                usleep(10000);
+            }
+        }
+        const double still(measure(100, [&](long){
+            FrameArena::beginFrame();
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            cloud.update(projection, modelview, 256.0f);
+            cloud.draw(projection, modelview, 256.0f);
+            glFinish();
+            window.swapBuffers();
+        }, 3));
+        std::snprintf(name, sizeof name, "still view, %d points", size);
+        std::snprintf(note, sizeof note, "%.3f ms/frame", still * 1.0e-6);
+        report(name, still, note);
+        
+        // 回る視点
+        const double orbit(measure(100, [&](long i){
+            FrameArena::beginFrame();
+            const Matrix turning(view * Matrix::rotate(0.05f * i, 0.0f, 1.0f, 0.0f) * center);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            cloud.update(projection, turning, 256.0f, 2.0f, size / 8, 500000);
+            cloud.draw(projection, turning, 256.0f);
+            glFinish();
+            window.swapBuffers();
+        }, 3));
+        std::snprintf(name, sizeof name, "orbit, budget 1/8, %d points", size);
+        std::snprintf(note, sizeof note, "%.3f ms/frame", orbit * 1.0e-6);
+        report(name, orbit, note);
+    }
+    
+    // 根の節点の点の数をファイルより大きくする
+    {
+        std::fstream file(hierarchy, std::ios::binary | std::ios::in | std::ios::out);
+        const uint32_t count(0xffffffff);
+        file.seekp(2 * sizeof(uint32_t) + offsetof(PointCloud::Node, count));
+        file.write(reinterpret_cast<const char *>(&count), sizeof count);
+    }
+    const bool rejected(PointCloud(directory).root() == NULL);
+    
+    unlink(input.c_str());
+    unlink(hierarchy.c_str());
+    unlink(points.c_str());
+    rmdir(directory);
+    
+    if (!rejected) {
+        std::printf("a hierarchy pointing outside points.bin was accepted\n");
+        return 1;
+    }
+    
+    return 0;
+}
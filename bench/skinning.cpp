@@ -0,0 +1,118 @@
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "bench.hpp"
+#include "context.hpp"
+#include "../load_window.hpp"
+#include "../class/Window.h"
+#include "../class/Program.h"
+#include "../class/Uniform.h"
+#include "../class/Material.h"
+#include "../class/SkinnedShape.h"
+#include "../class/ThreadPool.h"
+
+// 一秒あたりに変形できる頂点の数を CPU で変形する場合とバーテックスシェーダで変形する場合で比べる
+int main(){
+    if (!initContext()) {
+        return 1;
+    }
+    
+    Window window(256, 256, "skinning");
+    window.setPresentMode(FramePacer::UNLOCKED);
+    
+    // main.cpp の円柱を細かく分割して頂点を増やす
+    static constexpr int joints(4), slices(256), stacks(256);
+    static constexpr GLfloat step(2.0f / (joints - 1));
+    
+    std::vector<SkinnedShape::Vertex> vertex;
+    for (int j = 0; j <= stacks; ++j) {
+        const float y(2.0f * static_cast<float>(j) / static_cast<float>(stacks) - 1.0f);
+        const float f((y + 1.0f) / step);
+        const int j0(std::min(static_cast<int>(f), joints - 2));
+        const GLubyte w1(static_cast<GLubyte>(std::min(f - static_cast<float>(j0), 1.0f) * 255.0f));
+        
+        for (int i = 0; i <= slices; ++i) {
+            const float s(static_cast<float>(i) / static_cast<float>(slices));
+            const float z(cos(2.0f * 3.141593f * s)), x(sin(2.0f * 3.141593f * s));
+            
+            const SkinnedShape::Vertex v = {
+                { 0.3f * x, y, 0.3f * z }, { x, 0.0f, z },
+                { static_cast<GLubyte>(j0), static_cast<GLubyte>(j0 + 1), 0, 0 },
+                { static_cast<GLubyte>(255 - w1), w1, 0, 0 }
+            };
+            vertex.emplace_back(v);
+        }
+    }
+    
+    std::vector<GLuint> index;
+    for (int j = 0; j < stacks; ++j) {
+        for (int i = 0; i < slices; ++i) {
+            const GLuint k0((slices + 1) * j + i), k1(k0 + 1), k2(k1 + slices), k3(k2 + 1);
+            index.insert(index.end(), { k0, k2, k3, k0, k3, k1 });
+        }
+    }
+    
+    const size_t count(vertex.size());
+    const SkinnedShape shape(static_cast<GLsizei>(count), vertex.data(), static_cast<GLsizei>(index.size()), index.data());
+    
+    SkinnedShape::Palette palette;
+    for (int i = 0; i < joints; ++i) {
+        palette.joint[i] = Matrix::rotate(0.1f * i, 0.0f, 0.0f, 1.0f);
+    }
+    
+    ThreadPool pool;
+    char note[64];
+    
+    // 変形だけ
+    std::vector<Object::Vertex> out(count);
+    
+    const double single(measure(20, [&](long){
+        SkinnedShape::skin(palette.joint, vertex.data(), out.data(), count);
+        keep(out[0]);
+    }));
+    std::snprintf(note, sizeof note, "%.1f M vertices/s", count / single * 1.0e3);
+    report("cpu skinning, 1 thread", single, note);
+    
+    const double threaded(measure(20, [&](long){
+        pool.parallel(count, 4096, [&](size_t begin, size_t end){
+            SkinnedShape::skin(palette.joint, vertex.data() + begin, out.data() + begin, end - begin);
+        });
+        keep(out[0]);
+    }));
+    std::snprintf(note, sizeof note, "%.1f M vertices/s", count / threaded * 1.0e3);
+    report("cpu skinning, thread pool", threaded, note);
+    
+    // 描画が終わるまで. 投影行列は零のままなので三角形は潰れ, ほぼ頂点の処理だけが残る
+    static constexpr Material material = { 0.6f, 0.6f, 0.2f, 0.6f, 0.6f, 0.2f, 0.3f, 0.3f, 0.3f, 30.0f };
+    const Uniform<Material> materials(&material);
+    const Uniform<SkinnedShape::Palette> palettes(&palette);
+    
+    Program program(loadProgram("point.vert", "point.frag"));
+    program.bind<Material>("Material", 0);
+    
+    Program skinProgram(loadProgram("skin.vert", "point.frag"));
+    skinProgram.bind<Material>("Material", 0);
+    skinProgram.bind<SkinnedShape::Palette>("Palette", 1);
+    
+    materials.select(0);
+    
+    program.use();
+    const double cpu(measure(100, [&](long){
+        shape.draw(palette.joint, pool);
+        glFinish();
+    }));
+    std::snprintf(note, sizeof note, "%.1f M vertices/s", count / cpu * 1.0e3);
+    report("cpu skinning + draw", cpu, note);
+    
+    skinProgram.use();
+    const double gpu(measure(100, [&](long){
+        palettes.set(&palette);
+        palettes.select(1);
+        shape.draw();
+        glFinish();
+    }));
+    std::snprintf(note, sizeof note, "%.1f M vertices/s", count / gpu * 1.0e3);
+    report("gpu skinning + draw", gpu, note);
+    
+    return 0;
+}
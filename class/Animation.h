@@ -0,0 +1,68 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <GL/glew.h>
+#include "Matrix.h"
+#include "Quaternion.h"
+
+// 関節ごとの平行移動と回転のキーフレーム
+// 成分ごとの配列に [キー][関節] の順に並べ, 同じキーの全関節を連続して読めるようにする
+class Animation{
+    const int joints;
+    
+    std::vector<GLfloat> times;
+    
+    std::vector<GLfloat> tx, ty, tz;
+    std::vector<GLfloat> qx, qy, qz, qw;
+    
+public:
+    // translation は keys * joints 個の (x, y, z), rotation は keys * joints 個の四元数
+    Animation(int joints, int keys, const GLfloat *time, const GLfloat *translation, const Quaternion *rotation)
+    : joints(joints), times(time, time + keys){
+        const int n(keys * joints);
+        tx.resize(n); ty.resize(n); tz.resize(n);
+        qx.resize(n); qy.resize(n); qz.resize(n); qw.resize(n);
+        
+        for (int i = 0; i < n; ++i) {
+            tx[i] = translation[i * 3 + 0];
+            ty[i] = translation[i * 3 + 1];
+            tz[i] = translation[i * 3 + 2];
+            qx[i] = rotation[i].x;
+            qy[i] = rotation[i].y;
+            qz[i] = rotation[i].z;
+            qw[i] = rotation[i].w;
+        }
+    }
+    
+    GLfloat duration() const{
+        return times.back();
+    }
+    
+    // 時刻 time (繰り返し再生) の各関節のローカルな変換を local に求める
+    void sample(GLfloat time, Matrix *local) const{
+        const GLfloat d(duration());
+        if (d > 0.0f) {
+            time = std::fmod(time, d);
+            if (time < 0.0f) time += d;
+        }
+        
+        // time を挟むキー k0, k1 と補間の割合 t
+        const int last(static_cast<int>(times.size()) - 1);
+        const int k1(std::min(static_cast<int>(std::upper_bound(times.begin(), times.end(), time) - times.begin()), last));
+        const int k0(std::max(k1 - 1, 0));
+        const GLfloat span(times[k1] - times[k0]);
+        const GLfloat t(span > 0.0f ? (time - times[k0]) / span : 0.0f);
+        
+        const int a(k0 * joints), b(k1 * joints);
+        for (int j = 0; j < joints; ++j) {
+            const Quaternion q0{ qx[a + j], qy[a + j], qz[a + j], qw[a + j] };
+            const Quaternion q1{ qx[b + j], qy[b + j], qz[b + j], qw[b + j] };
+            
+            local[j] = Quaternion::transform(Quaternion::slerp(q0, q1, t),
+                tx[a + j] + (tx[b + j] - tx[a + j]) * t,
+                ty[a + j] + (ty[b + j] - ty[a + j]) * t,
+                tz[a + j] + (tz[b + j] - tz[a + j]) * t);
+        }
+    }
+};
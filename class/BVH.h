@@ -0,0 +1,428 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <vector>
+#include <GL/glew.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+#include "Ray.h"
+#include "ThreadPool.h"
+
+// 箱の集まりに対するバウンディングボリューム階層
+// ビンに分けた表面積ヒューリスティック (SAH) で分割し, 大きいときは部分木を ThreadPool で並列に作る
+class BVH{
+public:
+    struct Bounds{
+        GLfloat min[3];
+        GLfloat max[3];
+        
+        static Bounds empty(){
+            const GLfloat inf(std::numeric_limits<GLfloat>::infinity());
+            const Bounds b = { { inf, inf, inf }, { -inf, -inf, -inf } };
+            return b;
+        }
+        
+        void grow(const GLfloat *p){
+            for (int k = 0; k < 3; ++k) {
+                min[k] = std::min(min[k], p[k]);
+                max[k] = std::max(max[k], p[k]);
+            }
+        }
+        
+        void grow(const Bounds &b){
+            for (int k = 0; k < 3; ++k) {
+                min[k] = std::min(min[k], b.min[k]);
+                max[k] = std::max(max[k], b.max[k]);
+            }
+        }
+        
+        // 表面積の半分
+        GLfloat area() const{
+            const GLfloat x(max[0] - min[0]), y(max[1] - min[1]), z(max[2] - min[2]);
+            return x < 0.0f ? 0.0f : x * y + y * z + z * x;
+        }
+    };
+    
+    // count が 0 なら内部の節点で, 子は first と first + 1
+    // そうでなければ葉で, getOrder() の first から count 個の要素を持つ
+    struct Node{
+        GLfloat min[3];
+        uint32_t first;
+        GLfloat max[3];
+        uint32_t count;
+    };
+
+private:
+    std::vector<Node> nodes;
+    
+    // 葉の並びの i 番目の要素が元の何番目か
+    std::vector<GLuint> order;
+    
+    // 作り直すたびに確保しないように取っておく要素の中心
+    std::vector<GLfloat> centroid;
+    
+    static constexpr int bins = 16;
+    static constexpr size_t maxLeaf = 8;
+    static constexpr int maxDepth = 48;
+    
+    // 並列に作る部分木
+    struct Task{
+        uint32_t node;
+        size_t begin, end;
+        int depth;
+    };
+    
+    // 作っている間だけ使う入力と並び
+    struct Builder{
+        const Bounds *boxes;
+        const GLfloat *centroid;
+        GLuint *order;
+        
+        // 分けるなら分け目を, 葉にするなら end を返す
+        size_t split(size_t begin, size_t end, const Bounds &box, const Bounds &cbox) const{
+            const size_t n(end - begin);
+            if (n <= 2) {
+                return end;
+            }
+            
+            GLfloat bestCost(std::numeric_limits<GLfloat>::infinity());
+            int bestAxis(-1), bestBin(0);
+            
+            for (int k = 0; k < 3; ++k) {
+                const GLfloat extent(cbox.max[k] - cbox.min[k]);
+                if (!(extent > 0.0f)) {
+                    continue;
+                }
+                const GLfloat scale(bins * 0.9999f / extent);
+                
+                Bounds bin[bins];
+                size_t count[bins] = {};
+                std::fill(bin, bin + bins, Bounds::empty());
+                
+                for (size_t i = begin; i < end; ++i) {
+                    const GLuint p(order[i]);
+                    const int b(static_cast<int>((centroid[3 * p + k] - cbox.min[k]) * scale));
+                    bin[b].grow(boxes[p]);
+                    ++count[b];
+                }
+                
+                // 右から累積した面積と数
+                GLfloat rightArea[bins];
+                size_t rightCount[bins];
+                Bounds r(Bounds::empty());
+                size_t rn(0);
+                for (int b = bins - 1; b > 0; --b) {
+                    r.grow(bin[b]);
+                    rn += count[b];
+                    rightArea[b] = r.area();
+                    rightCount[b] = rn;
+                }
+                
+                Bounds l(Bounds::empty());
+                size_t ln(0);
+                for (int b = 0; b < bins - 1; ++b) {
+                    l.grow(bin[b]);
+                    ln += count[b];
+                    if (ln == 0 || rightCount[b + 1] == 0) {
+                        continue;
+                    }
+                    
+                    const GLfloat cost(l.area() * ln + rightArea[b + 1] * rightCount[b + 1]);
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = k;
+                        bestBin = b;
+                    }
+                }
+            }
+            
+            if (bestAxis < 0) {
+                // 中心がすべて重なっているときは並びのまま半分にする
+                return n > maxLeaf ? begin + n / 2 : end;
+            }
+            
+            // 辿る費用を 1, 要素との交差判定を 1 として葉と比べる
+            const GLfloat area(box.area());
+            if (n <= maxLeaf && (area <= 0.0f || 1.0f + bestCost / area >= static_cast<GLfloat>(n))) {
+                return end;
+            }
+            
+            const int k(bestAxis);
+            const GLfloat scale(bins * 0.9999f / (cbox.max[k] - cbox.min[k]));
+            const GLfloat origin(cbox.min[k]);
+            GLuint *const mid(std::partition(order + begin, order + end, [&](GLuint p){
+                return static_cast<int>((centroid[3 * p + k] - origin) * scale) <= bestBin;
+            }));
+            
+            const size_t m(static_cast<size_t>(mid - order));
+            return m == begin || m == end ? begin + n / 2 : m;
+        }
+        
+        // index の節点に [begin, end) の部分木を作る
+        // tasks があれば threshold 個以下の部分木は作らずに tasks に回す
+        void subdivide(std::vector<Node> &out, uint32_t index, size_t begin, size_t end, int depth,
+                       std::vector<Task> *tasks, size_t threshold) const{
+            if (tasks != NULL && end - begin <= threshold) {
+                const Task t = { index, begin, end, depth };
+                tasks->push_back(t);
+                return;
+            }
+            
+            Bounds box(Bounds::empty()), cbox(Bounds::empty());
+            for (size_t i = begin; i < end; ++i) {
+                box.grow(boxes[order[i]]);
+                cbox.grow(centroid + 3 * order[i]);
+            }
+            
+            std::copy(box.min, box.min + 3, out[index].min);
+            std::copy(box.max, box.max + 3, out[index].max);
+            
+            const size_t mid(depth < maxDepth ? split(begin, end, box, cbox) : end);
+            if (mid == end) {
+                out[index].first = static_cast<uint32_t>(begin);
+                out[index].count = static_cast<uint32_t>(end - begin);
+                return;
+            }
+            
+            const uint32_t left(static_cast<uint32_t>(out.size()));
+            out.resize(left + 2);
+            out[index].first = left;
+            out[index].count = 0;
+            
+            subdivide(out, left, begin, mid, depth + 1, tasks, threshold);
+            subdivide(out, left + 1, mid, end, depth + 1, tasks, threshold);
+        }
+    };
+    
+    // 方向の成分の逆数. 0 のままだと箱の面の上から出る光線で 0 * inf が NaN になるので, 符号を保って小さな値に置き換える
+    static GLfloat reciprocal(GLfloat d){
+        static constexpr GLfloat tiny = 1.0e-20f;
+        return 1.0f / (std::fabs(d) < tiny ? std::copysign(tiny, d) : d);
+    }
+    
+    // 光線と節点の箱が t より手前で交わるか調べ, 入る距離を near に求める
+    static bool slab(const Node &n, const GLfloat *origin, const GLfloat *inv, GLfloat t, GLfloat &near){
+        GLfloat t0(0.0f), t1(t);
+        for (int k = 0; k < 3; ++k) {
+            const GLfloat a((n.min[k] - origin[k]) * inv[k]);
+            const GLfloat b((n.max[k] - origin[k]) * inv[k]);
+            t0 = std::max(t0, std::min(a, b));
+            t1 = std::min(t1, std::max(a, b));
+        }
+        near = t0;
+        return t0 <= t1;
+    }
+
+public:
+    // boxes[i] を囲む階層を作り直す. pool があれば大きな部分木を並列に作る
+    void build(const std::vector<Bounds> &boxes, ThreadPool *pool = NULL){
+        const size_t count(boxes.size());
+        
+        nodes.clear();
+        order.resize(count);
+        std::iota(order.begin(), order.end(), 0);
+        if (count == 0) {
+            return;
+        }
+        
+        centroid.resize(3 * count);
+        for (size_t i = 0; i < count; ++i) {
+            for (int k = 0; k < 3; ++k) {
+                centroid[3 * i + k] = (boxes[i].min[k] + boxes[i].max[k]) * 0.5f;
+            }
+        }
+        
+        const Builder builder = { boxes.data(), centroid.data(), order.data() };
+        
+        // 上の方の節点は一つのスレッドで分け, スレッド数の 4 倍ほどの部分木にしてから並列に作る
+        static constexpr size_t parallelThreshold = 16384;
+        const bool parallel(pool != NULL && pool->size() > 1 && count > parallelThreshold);
+        const size_t threshold(parallel ? std::max(count / (4 * pool->size()), parallelThreshold / 4) : 0);
+        
+        std::vector<Task> tasks;
+        nodes.resize(1);
+        nodes.reserve(2 * count / maxLeaf + 1);
+        builder.subdivide(nodes, 0, 0, count, 0, parallel ? &tasks : NULL, threshold);
+        
+        if (tasks.empty()) {
+            return;
+        }
+        
+        std::vector<std::vector<Node>> local(tasks.size());
+        pool->parallel(tasks.size(), 1, [&](size_t begin, size_t end){
+            for (size_t i = begin; i < end; ++i) {
+                const Task &t(tasks[i]);
+                local[i].resize(1);
+                builder.subdivide(local[i], 0, t.begin, t.end, t.depth, NULL, 0);
+            }
+        });
+        
+        // 部分木の根を予約してあった節点に置き, 残りを後ろにつなげて子の番号をずらす
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            const uint32_t base(static_cast<uint32_t>(nodes.size()) - 1);
+            for (size_t j = 0; j < local[i].size(); ++j) {
+                Node n(local[i][j]);
+                if (n.count == 0) {
+                    n.first += base;
+                }
+                
+                if (j == 0) {
+                    nodes[tasks[i].node] = n;
+                } else {
+                    nodes.push_back(n);
+                }
+            }
+        }
+    }
+    
+    bool empty() const{
+        return nodes.empty();
+    }
+    
+    const std::vector<Node> &getNodes() const{
+        return nodes;
+    }
+    
+    const std::vector<GLuint> &getOrder() const{
+        return order;
+    }
+    
+    // 全体を囲む箱
+    Bounds bounds() const{
+        if (nodes.empty()) {
+            return Bounds::empty();
+        }
+        
+        Bounds b;
+        std::copy(nodes[0].min, nodes[0].min + 3, b.min);
+        std::copy(nodes[0].max, nodes[0].max + 3, b.max);
+        return b;
+    }
+    
+    // 光線が hit.t より手前で箱に入る葉の要素について, 近い順に leaf(葉の並びの番号) を呼ぶ
+    // leaf は当たれば hit.t を縮める
+    template <typename F>
+    void intersect(const Ray &ray, Hit &hit, const F &leaf) const{
+        if (nodes.empty()) {
+            return;
+        }
+        
+        GLfloat inv[3];
+        for (int k = 0; k < 3; ++k) {
+            inv[k] = reciprocal(ray.direction[k]);
+        }
+        
+        uint32_t stack[maxDepth + 2];
+        int top(0);
+        GLfloat near;
+        uint32_t n(slab(nodes[0], ray.origin, inv, hit.t, near) ? 0 : UINT32_MAX);
+        
+        while (n != UINT32_MAX) {
+            const Node &node(nodes[n]);
+            
+            if (node.count > 0) {
+                for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                    leaf(i);
+                }
+                n = top > 0 ? stack[--top] : UINT32_MAX;
+                continue;
+            }
+            
+            GLfloat t0, t1;
+            const bool h0(slab(nodes[node.first], ray.origin, inv, hit.t, t0));
+            const bool h1(slab(nodes[node.first + 1], ray.origin, inv, hit.t, t1));
+            
+            if (h0 && h1) {
+                // 近い方から辿り, 遠い方は後回しにする
+                const bool swap(t1 < t0);
+                stack[top++] = node.first + (swap ? 0 : 1);
+                n = node.first + (swap ? 1 : 0);
+            } else if (h0 || h1) {
+                n = node.first + (h0 ? 0 : 1);
+            } else {
+                n = top > 0 ? stack[--top] : UINT32_MAX;
+            }
+        }
+    }
+    
+    // 4 本の光線をまとめて辿る. どれかの光線が箱に入る葉について leaf(葉の並びの番号, 入った光線のビット) を呼ぶ
+    template <typename F>
+    void intersect(const Ray *ray, Hit *hit, const F &leaf) const{
+        if (nodes.empty()) {
+            return;
+        }
+
+#if defined(__SSE__)
+        __m128 o[3], inv[3];
+        for (int k = 0; k < 3; ++k) {
+            o[k] = _mm_setr_ps(ray[0].origin[k], ray[1].origin[k], ray[2].origin[k], ray[3].origin[k]);
+            inv[k] = _mm_setr_ps(reciprocal(ray[0].direction[k]), reciprocal(ray[1].direction[k]),
+                                 reciprocal(ray[2].direction[k]), reciprocal(ray[3].direction[k]));
+        }
+        
+        // 4 本の光線と箱の交差. 入る距離を near に求め, 当たった光線のビットを返す
+        const auto test = [&](const Node &node, __m128 &near){
+            const __m128 t(_mm_setr_ps(hit[0].t, hit[1].t, hit[2].t, hit[3].t));
+            __m128 t0(_mm_setzero_ps()), t1(t);
+            for (int k = 0; k < 3; ++k) {
+                const __m128 a(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min[k]), o[k]), inv[k]));
+                const __m128 b(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max[k]), o[k]), inv[k]));
+                t0 = _mm_max_ps(t0, _mm_min_ps(a, b));
+                t1 = _mm_min_ps(t1, _mm_max_ps(a, b));
+            }
+            near = t0;
+            return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+        };
+        
+        uint32_t stack[maxDepth + 2];
+        int top(0);
+        __m128 near;
+        uint32_t n(test(nodes[0], near) != 0 ? 0 : UINT32_MAX);
+        
+        while (n != UINT32_MAX) {
+            const Node &node(nodes[n]);
+            
+            if (node.count > 0) {
+                const int mask(test(node, near));
+                if (mask != 0) {
+                    for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                        leaf(i, mask);
+                    }
+                }
+                n = top > 0 ? stack[--top] : UINT32_MAX;
+                continue;
+            }
+            
+            __m128 near0, near1;
+            const int m0(test(nodes[node.first], near0));
+            const int m1(test(nodes[node.first + 1], near1));
+            
+            if (m0 != 0 && m1 != 0) {
+                // 当たった光線の入る距離の和が小さい方から辿る
+                alignas(16) GLfloat d[4];
+                _mm_store_ps(d, _mm_sub_ps(near1, near0));
+                GLfloat sum(0.0f);
+                for (int k = 0; k < 4; ++k) {
+                    if ((m0 & m1) & (1 << k)) sum += d[k];
+                }
+                
+                const bool swap(sum < 0.0f);
+                stack[top++] = node.first + (swap ? 0 : 1);
+                n = node.first + (swap ? 1 : 0);
+            } else if (m0 != 0 || m1 != 0) {
+                n = node.first + (m0 != 0 ? 0 : 1);
+            } else {
+                n = top > 0 ? stack[--top] : UINT32_MAX;
+            }
+        }
+#else
+        for (int k = 0; k < 4; ++k) {
+            intersect(ray[k], hit[k], [&](uint32_t i){ leaf(i, 1 << k); });
+        }
+#endif
+    }
+};
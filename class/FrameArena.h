@@ -0,0 +1,191 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// 1 フレームの間だけ使うデータを先頭から順に切り出す領域
+// スレッドごとに一つあり, followFrames() したスレッドのものは beginFrame() のあと最初に使ったときに空に戻る
+// 描画スレッドとそのフレームの中で仕事を終えるワーカーだけが followFrames() する
+// 仕事がフレームをまたぐスレッドは自分で reset() する (そうしないと使っている途中で空に戻ってしまう)
+// 足りなくなったら追加の領域を確保し, 次に空に戻したときからは合計の大きさの領域を一つ使う
+class FrameArena{
+    struct Block{
+        Block *next;
+        size_t size;
+    };
+    
+    // 今使っている領域 (古いものは next につながる)
+    Block *block;
+    size_t used;
+    
+    // 空に戻してから使った量の合計と, それまでの最大
+    size_t total;
+    size_t peak;
+    
+    // 空に戻したときのフレームの番号
+    unsigned long frame;
+    
+    // beginFrame() に合わせて空に戻すか
+    bool follows;
+    
+    static std::atomic<unsigned long> &currentFrame(){
+        static std::atomic<unsigned long> counter(0);
+        return counter;
+    }
+    
+    static Block *newBlock(size_t size, Block *next){
+        Block *const b(static_cast<Block *>(std::malloc(sizeof(Block) + size)));
+        if (b == NULL) {
+            throw std::bad_alloc();
+        }
+        
+        b->next = next;
+        b->size = size;
+        return b;
+    }
+    
+    static unsigned char *data(Block *b){
+        return reinterpret_cast<unsigned char *>(b + 1);
+    }
+    
+    // 今の領域の先頭から offset 以降で alignment にそろった位置
+    size_t align(size_t offset, size_t alignment) const{
+        const uintptr_t p(reinterpret_cast<uintptr_t>(data(block)) + offset);
+        return offset + ((alignment - p % alignment) % alignment);
+    }
+    
+    // フレームに合わせるスレッドでフレームが変わっていたら空に戻す
+    void refresh(){
+        if (!follows) {
+            return;
+        }
+        
+        const unsigned long f(currentFrame().load(std::memory_order_relaxed));
+        if (f != frame) {
+            frame = f;
+            reset();
+        }
+    }
+    
+    FrameArena(size_t size)
+    : block(newBlock(size, NULL)), used(0), total(0), peak(0), frame(currentFrame().load()), follows(false){
+        
+    }
+    
+    FrameArena(const FrameArena &a);
+    FrameArena &operator=(const FrameArena &a);
+    
+public:
+    virtual ~FrameArena(){
+        while (block != NULL) {
+            Block *const next(block->next);
+            std::free(block);
+            block = next;
+        }
+    }
+    
+    // 呼び出したスレッドの領域
+    static FrameArena &local(){
+        thread_local FrameArena arena(1 << 20);
+        return arena;
+    }
+    
+    // 新しいフレームを始める. 描画スレッドでフレームの先頭に呼ぶ
+    // 呼び出したスレッドの領域はこれからフレームに合わせて空に戻る
+    static void beginFrame(){
+        currentFrame().fetch_add(1, std::memory_order_relaxed);
+        local().followFrames();
+    }
+    
+    // 呼び出したスレッドの領域をフレームに合わせて空に戻すようにする
+    void followFrames(){
+        if (!follows) {
+            follows = true;
+            frame = currentFrame().load(std::memory_order_relaxed);
+        }
+    }
+    
+    // 切り出したものをすべて捨てて空に戻す
+    void reset(){
+        peak = total > peak ? total : peak;
+        
+        // 追加の領域を使っていたら一つにまとめる
+        if (block != NULL && block->next != NULL) {
+            size_t size(0);
+            while (block != NULL) {
+                Block *const next(block->next);
+                size += block->size;
+                std::free(block);
+                block = next;
+            }
+            block = newBlock(size, NULL);
+        }
+        
+        used = 0;
+        total = 0;
+    }
+    
+    void *allocate(size_t size, size_t alignment){
+        refresh();
+        
+        size_t offset(align(used, alignment));
+        if (offset + size > block->size) {
+            const size_t grow(size + alignment);
+            block = newBlock(grow > 2 * block->size ? grow : 2 * block->size, block);
+            used = 0;
+            offset = align(0, alignment);
+        }
+        
+        total += offset + size - used;
+        used = offset + size;
+        
+        return data(block) + offset;
+    }
+    
+    // 空に戻すまでの間に使った量の最大 [バイト]. 今使っている分も含める
+    size_t getPeak() const{
+        return total > peak ? total : peak;
+    }
+};
+
+// FrameArena から確保する STL のアロケータ. 解放はフレームが変わったときにまとめて行われる
+template <typename T>
+class ArenaAllocator{
+    template <typename U> friend class ArenaAllocator;
+    
+    FrameArena *arena;
+    
+public:
+    using value_type = T;
+    
+    ArenaAllocator(FrameArena &arena = FrameArena::local())
+    : arena(&arena){
+        
+    }
+    
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &a)
+    : arena(a.arena){
+        
+    }
+    
+    T *allocate(size_t n){
+        return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+    
+    void deallocate(T *, size_t){
+        
+    }
+    
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &a) const{
+        return arena == a.arena;
+    }
+    
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &a) const{
+        return arena != a.arena;
+    }
+};
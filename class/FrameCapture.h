@@ -0,0 +1,287 @@
+#pragma once
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <GL/glew.h>
+#include "../image.hpp"
+#include "../log.hpp"
+#include "ResourcePool.h"
+
+// 描いたフレームをピクセルパックバッファの輪に読み込み, フェンスが通った数フレーム後にマップして取り出す
+// 取り出したフレームはワーカースレッドがマップしたまま読んで PNG の連番か YUV (I420) の一つのファイルに書き出し,
+// 描画スレッドが次に capture() したときにマップを解く
+class FrameCapture{
+public:
+    enum Format{ PNG, YUV };
+    
+    struct Counters{
+        // 読み込みを頼んだフレームと書き出したフレーム
+        unsigned long captured;
+        unsigned long written;
+        
+        // フェンスやワーカーを待って描画スレッドが止まった回数
+        unsigned long stalls;
+        
+        // マップできずに書き出さなかったフレーム
+        unsigned long skipped;
+    };
+
+private:
+    struct Slot{
+        ResourcePool::Buffer pbo;
+        GLsync fence;
+        GLsizei width, height;
+        
+        // ワーカーが読んでいる間は true
+        bool mapped;
+    };
+    
+    struct Job{
+        unsigned long frame;
+        GLsizei width, height;
+        const unsigned char *pixels;
+        size_t slot;
+    };
+    
+    const std::string path;
+    const Format format;
+    const size_t depth;
+    
+    // 読み込み中の depth + 1 個と, ワーカーが読んでいるもののスロット
+    std::vector<Slot> slots;
+    
+    // 次に読み込む輪の位置と, 取り出していない中で一番古い位置
+    size_t head, tail, pending;
+    
+    // ワーカーに渡したフレームの数
+    unsigned long queued;
+    
+    // ワーカーとのやり取り. finished はワーカーが読み終えてマップを解くのを待つスロット
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    std::deque<Job> jobs;
+    std::vector<size_t> finished;
+    unsigned long nextWrite;
+    bool stopping;
+    std::vector<std::thread> workers;
+    
+    FILE *yuv;
+    
+    Counters counters;
+    
+    void work(){
+        std::vector<unsigned char> converted;
+        std::unique_lock<std::mutex> lock(mutex);
+        
+        for (;;) {
+            wake.wait(lock, [&]{ return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;
+            }
+            
+            const Job job(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+            
+            if (format == PNG) {
+                char name[32];
+                std::snprintf(name, sizeof name, "/frame%06lu.png", job.frame);
+                writePNG((path + name).c_str(), job.pixels, job.width, job.height);
+                lock.lock();
+            } else {
+                // 変換は並列に, 書き込みはフレームの順に行う
+                // 幅か高さが奇数なら最後の列と最初の行 (上下を返すと最後の行) を飛ばして読む
+                const GLsizei w(job.width & ~1), h(job.height & ~1);
+                if (w > 0 && h > 0) {
+                    const size_t stride(static_cast<size_t>(job.width) * 4);
+                    converted.resize(static_cast<size_t>(w) * h * 3 / 2);
+                    convertI420(job.pixels + (job.height - h) * stride, w, h, converted.data(), true, stride);
+                }
+                
+                lock.lock();
+                done.wait(lock, [&]{ return nextWrite == job.frame; });
+                if (w > 0 && h > 0 && yuv != NULL) {
+                    std::fwrite(converted.data(), 1, converted.size(), yuv);
+                }
+                ++nextWrite;
+            }
+            
+            ++counters.written;
+            finished.push_back(job.slot);
+            done.notify_all();
+        }
+    }
+    
+    // ワーカーが読み終えたスロットのマップを解く. GL を呼ぶので描画スレッドで呼ぶ
+    void unmapFinished(){
+        std::lock_guard<std::mutex> lock(mutex);
+        if (finished.empty()) {
+            return;
+        }
+        
+        for (size_t i : finished) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slots[i].pbo.name);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            slots[i].mapped = false;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        finished.clear();
+    }
+    
+    // 一番古いスロットをマップしてワーカーに渡す. wait でなければ GPU が終わっていないとき false を返す
+    bool retire(bool wait){
+        Slot &s(slots[tail]);
+        
+        const GLenum status(glClientWaitSync(s.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000 : 0));
+        if (status == GL_TIMEOUT_EXPIRED) {
+            return false;
+        }
+        if (wait) {
+            ++counters.stalls;
+        }
+        glDeleteSync(s.fence);
+        s.fence = 0;
+        
+        // 写さずにマップしたまま渡す
+        const size_t size(static_cast<size_t>(s.width) * s.height * 4);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo.name);
+        const void *const p(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT));
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        
+        if (p == NULL) {
+            logMessage(LOG_ERROR, LOG_GL, "cant map captured frame {} ({}x{}), skipping it", counters.captured - pending, s.width, s.height);
+            ++counters.skipped;
+        } else {
+            s.mapped = true;
+            const Job job = { queued++, s.width, s.height, static_cast<const unsigned char *>(p), tail };
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push_back(job);
+            }
+            wake.notify_one();
+        }
+        
+        tail = (tail + 1) % slots.size();
+        --pending;
+        return true;
+    }
+
+public:
+    // format が PNG なら path のディレクトリに frame000000.png から, YUV なら path のファイルに続けて書く
+    // depth はフレームを読み込んでから取り出すまでのフレーム数
+    // 書き出しが追いつかないときはワーカーの数のほかに depth + 1 フレームまで溜める
+    FrameCapture(const std::string &path, Format format, int depth = 3, unsigned int workerCount = 2)
+    : path(path), format(format), depth(depth), slots(2 * (depth + 1) + workerCount), head(0), tail(0), pending(0), queued(0)
+    , nextWrite(0), stopping(false)
+    , yuv(format == YUV ? std::fopen(path.c_str(), "wb") : NULL), counters(){
+        if (format == YUV && yuv == NULL) {
+            logMessage(LOG_ERROR, LOG_RESOURCE, "cant create capture file: {}", path);
+        }
+        
+        for (Slot &s : slots) {
+            s.pbo.name = 0;
+            s.pbo.capacity = 0;
+            s.fence = 0;
+            s.mapped = false;
+        }
+        finished.reserve(slots.size());
+        
+        for (unsigned int i = 0; i < workerCount; ++i) {
+            workers.emplace_back(&FrameCapture::work, this);
+        }
+    }
+    
+    // 残ったフレームをすべて書き出してから終わる
+    virtual ~FrameCapture(){
+        while (pending > 0) {
+            retire(true);
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &t : workers) {
+            t.join();
+        }
+        unmapFinished();
+        
+        ResourcePool &pool(ResourcePool::instance());
+        for (Slot &s : slots) {
+            pool.releaseBuffer(s.pbo);
+        }
+        
+        if (yuv != NULL) {
+            std::fclose(yuv);
+        }
+        
+        logMessage(LOG_INFO, LOG_RESOURCE, "capture {}: {} frames captured, {} written, {} skipped, {} stalls",
+                   path, counters.captured, counters.written, counters.skipped, counters.stalls);
+    }
+
+private:
+    FrameCapture(const FrameCapture &c);
+    FrameCapture &operator=(const FrameCapture &c);
+
+public:
+    // バックバッファを描き終えて swapBuffers() する前に呼ぶ
+    void capture(){
+        // 読み込み中のフレームが depth + 1 個あれば一番古いフレームを待って取り出す
+        while (pending == depth + 1) {
+            retire(true);
+        }
+        
+        // 輪を一周してワーカーがまだ読んでいるスロットに戻ってきたら, 読み終わるまで待つ
+        unmapFinished();
+        if (slots[head].mapped) {
+            ++counters.stalls;
+            do {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    done.wait(lock, [&]{ return !finished.empty(); });
+                }
+                unmapFinished();
+            } while (slots[head].mapped);
+        }
+        
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        
+        Slot &s(slots[head]);
+        s.width = viewport[2];
+        s.height = viewport[3];
+        
+        const GLsizeiptr size(static_cast<GLsizeiptr>(s.width) * s.height * 4);
+        ResourcePool &pool(ResourcePool::instance());
+        if (s.pbo.capacity < size) {
+            pool.releaseBuffer(s.pbo);
+            s.pbo = pool.createBuffer(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        } else {
+            pool.touch(s.pbo);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo.name);
+        }
+        
+        // 読み込み先がバッファなので glReadPixels は GPU を待たずに戻る
+        glReadPixels(viewport[0], viewport[1], s.width, s.height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        
+        s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        head = (head + 1) % slots.size();
+        ++pending;
+        ++counters.captured;
+        
+        // depth フレーム前のものから終わっている順に取り出す
+        while (pending > depth && retire(false)) {
+        }
+    }
+    
+    Counters getCounters(){
+        std::lock_guard<std::mutex> lock(mutex);
+        return counters;
+    }
+};
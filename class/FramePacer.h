@@ -0,0 +1,216 @@
+#pragma once
+#include <chrono>
+#include <thread>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+// 表示の同期方法, フレームレートの制限, 1 フレームの時間の計測をまとめて扱う
+class FramePacer{
+public:
+    enum Mode{
+        VSYNC,       // 垂直同期を待つ
+        UNLOCKED,    // 垂直同期を待たない
+        ADAPTIVE,    // 間に合わなかったフレームだけ垂直同期を待たずに表示する
+        LOW_LATENCY  // 垂直同期を待ち, GPU に積むフレームを maxFrames 枚までにする
+    };
+    
+    // 1 フレームの計測結果 [秒]
+    struct Timing{
+        double cpu;      // フレームの開始から swap までの CPU 時間
+        double gpu;      // GPU がそのフレームの描画にかけた時間 (数フレーム遅れて得られる)
+        double present;  // swap にかかった時間
+        double wait;     // フレームレートの制限と GPU を待った時間
+        double latency;  // 入力のサンプリングから表示までの時間
+        double frame;    // 前のフレームの開始からの時間
+    };
+    
+private:
+    static constexpr int queryCount = 4;
+    static constexpr int fenceCount = 2;
+    
+    Mode mode;
+    
+    // LOW_LATENCY で GPU に積むフレームの数 (1 か 2)
+    int maxFrames;
+    
+    // フレームレートの制限の周期 (0 なら制限しない)
+    double interval;
+    
+    // この時間を残したら sleep をやめて spin で待つ
+    double spin;
+    
+    double deadline;
+    double frameStart;
+    double swapStart;
+    
+    GLsync fence[fenceCount];
+    int fenceIndex;
+    
+    // GPU 時間を測るクエリ. 結果が出るまで待たないように輪番で使う
+    GLuint query[queryCount];
+    bool queryIssued[queryCount];
+    int queryIndex;
+    bool timerQuery;
+    
+    Timing timing;
+    
+public:
+    FramePacer()
+    : mode(VSYNC), maxFrames(1), interval(0.0), spin(0.002)
+    , deadline(0.0), frameStart(0.0), swapStart(0.0)
+    , fence{}, fenceIndex(0), query{}, queryIssued{}, queryIndex(0)
+    , timerQuery(false), timing(){
+        
+    }
+    
+    virtual ~FramePacer(){
+        release();
+    }
+    
+private:
+    FramePacer(const FramePacer &p);
+    FramePacer &operator=(const FramePacer &p);
+    
+public:
+    // カレントの GL コンテキストに表示の方法を設定する
+    void setMode(Mode m, int frames = 1){
+        mode = m;
+        maxFrames = frames < 1 ? 1 : frames > fenceCount ? fenceCount : frames;
+        
+        switch (mode) {
+            case UNLOCKED:
+                glfwSwapInterval(0);
+                break;
+            case ADAPTIVE:
+                glfwSwapInterval(glfwExtensionSupported("WGL_EXT_swap_control_tear")
+                    || glfwExtensionSupported("GLX_EXT_swap_control_tear") ? -1 : 1);
+                break;
+            default:
+                glfwSwapInterval(1);
+                break;
+        }
+        
+        if (!timerQuery && GLEW_ARB_timer_query) {
+            glGenQueries(queryCount, query);
+            timerQuery = true;
+        }
+    }
+    
+    Mode getMode() const{
+        return mode;
+    }
+    
+    // フレームレートの上限を設定する (0 なら制限しない)
+    void setLimit(double fps){
+        interval = fps > 0.0 ? 1.0 / fps : 0.0;
+        deadline = 0.0;
+    }
+    
+    // フレームの処理を始める前に呼ぶ. 上限を超えないように待つ
+    void beginFrame(){
+        const double start(glfwGetTime());
+        
+        if (mode == LOW_LATENCY) {
+            // maxFrames 枚前のフレームの描画が終わるまで待つ
+            GLsync &f(fence[(fenceIndex + fenceCount - maxFrames) % fenceCount]);
+            if (f != 0) {
+                glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+                glDeleteSync(f);
+                f = 0;
+            }
+        }
+        
+        if (interval > 0.0) {
+            double now(glfwGetTime());
+            
+            if (deadline == 0.0 || now - deadline > interval) {
+                // 大きく遅れたらそこから数え直す
+                deadline = now;
+            }
+            
+            if (deadline - now > spin) {
+                std::this_thread::sleep_for(std::chrono::duration<double>(deadline - now - spin));
+            }
+            while (glfwGetTime() < deadline) {
+                std::this_thread::yield();
+            }
+            
+            deadline += interval;
+        }
+        
+        const double now(glfwGetTime());
+        timing.wait = now - start;
+        timing.frame = now - frameStart;
+        frameStart = now;
+        
+        if (timerQuery) {
+            readQuery();
+            glBeginQuery(GL_TIME_ELAPSED, query[queryIndex]);
+        }
+    }
+    
+    // swap の直前に呼ぶ
+    void beforeSwap(){
+        if (timerQuery) {
+            glEndQuery(GL_TIME_ELAPSED);
+            queryIssued[queryIndex] = true;
+            queryIndex = (queryIndex + 1) % queryCount;
+        }
+        
+        swapStart = glfwGetTime();
+        timing.cpu = swapStart - frameStart;
+    }
+    
+    // swap の直後に呼ぶ. inputTime はこのフレームに反映した入力のサンプリング時刻
+    void afterSwap(double inputTime){
+        const double now(glfwGetTime());
+        timing.present = now - swapStart;
+        timing.latency = inputTime > 0.0 ? now - inputTime : 0.0;
+        
+        if (mode == LOW_LATENCY) {
+            GLsync &f(fence[fenceIndex]);
+            if (f != 0) glDeleteSync(f);
+            f = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            fenceIndex = (fenceIndex + 1) % fenceCount;
+        }
+    }
+    
+    const Timing &getTiming() const{
+        return timing;
+    }
+    
+    // フェンスとクエリを捨てる. GL コンテキストを壊す前に呼ぶ
+    void release(){
+        for (int i = 0; i < fenceCount; ++i) {
+            if (fence[i] != 0) glDeleteSync(fence[i]);
+            fence[i] = 0;
+        }
+        
+        if (timerQuery) {
+            glDeleteQueries(queryCount, query);
+            timerQuery = false;
+        }
+        
+        for (int i = 0; i < queryCount; ++i) {
+            query[i] = 0;
+            queryIssued[i] = false;
+        }
+    }
+    
+private:
+    // 一巡前に発行したクエリの結果が出ていれば受け取る
+    void readQuery(){
+        if (!queryIssued[queryIndex]) {
+            return;
+        }
+        
+        GLint available;
+        glGetQueryObjectiv(query[queryIndex], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 elapsed;
+            glGetQueryObjectui64v(query[queryIndex], GL_QUERY_RESULT, &elapsed);
+            timing.gpu = static_cast<double>(elapsed) * 1.0e-9;
+        }
+        queryIssued[queryIndex] = false;
+    }
+};
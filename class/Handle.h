@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <utility>
+
+// 描画スレッドだけで共有するオブジェクトへの参照カウント付きポインタ
+// std::shared_ptr と違って参照カウントをアトミックに操作しない
+template <typename T>
+class Handle{
+    struct Block{
+        unsigned int count;
+        T value;
+        
+        template <typename... Args>
+        Block(Args&&... args)
+        : count(1), value(std::forward<Args>(args)...){
+            
+        }
+    };
+    
+    Block *block;
+    
+    explicit Handle(Block *block)
+    : block(block){
+        
+    }
+    
+public:
+    // T をコンストラクタの引数 args で作る
+    template <typename... Args>
+    static Handle make(Args&&... args){
+        return Handle(new Block(std::forward<Args>(args)...));
+    }
+    
+    Handle()
+    : block(NULL){
+        
+    }
+    
+    Handle(const Handle &h)
+    : block(h.block){
+        if (block != NULL) ++block->count;
+    }
+    
+    Handle(Handle &&h)
+    : block(h.block){
+        h.block = NULL;
+    }
+    
+    ~Handle(){
+        if (block != NULL && --block->count == 0) {
+            delete block;
+        }
+    }
+    
+    Handle &operator=(Handle h){
+        std::swap(block, h.block);
+        return *this;
+    }
+    
+    T *operator->() const{
+        return &block->value;
+    }
+    
+    T &operator*() const{
+        return block->value;
+    }
+    
+    explicit operator bool() const{
+        return block != NULL;
+    }
+};
@@ -1,6 +1,8 @@
 #pragma once
 #include <array>
+#include <cstddef>
 #include <GL/glew.h>
+#include "Std140.h"
 
 struct Material{
     alignas(16) std::array<GLfloat, 3> ambient;
@@ -8,3 +10,8 @@ struct Material{
     alignas(16) std::array<GLfloat, 3> specular;
     alignas(4) GLfloat shininess;
 };
+
+// point.frag の layout (std140) uniform Material と同じ並びになっているか確かめる
+static_assert(Std140::matches<std::array<GLfloat, 3>, std::array<GLfloat, 3>, std::array<GLfloat, 3>, GLfloat>({
+    offsetof(Material, ambient), offsetof(Material, diffuse), offsetof(Material, specular), offsetof(Material, shininess)
+}), "Material does not follow the std140 layout");
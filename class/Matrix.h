@@ -1,24 +1,103 @@
 #pragma once
-#include <algorithm>
 #include <cmath>
+#include <type_traits>
 #include <GL/glew.h>
 
-class Matrix{
+// 行列の式の基底. 積の連鎖を一時的な行列を作らずに一度に計算するために使う
+template <typename E>
+struct MatrixExpression{
+    constexpr const E &self() const{
+        return static_cast<const E &>(*this);
+    }
+};
+
+// 行列の積 l * r の式. L と R は左辺値の項なら const 参照, 一時的な行列や式なら値の型
+// auto で保存しても一時的な項を指したままにならないように, 一時的なものは値で持つ
+template <typename L, typename R>
+class MatrixProduct : public MatrixExpression<MatrixProduct<L, R>>{
+    const L l;
+    const R r;
+    
+public:
+    constexpr MatrixProduct(const L &l, const R &r)
+    : l(l), r(r){
+        
+    }
+    
+    // 式の行列と列ベクトル v の積を out に求める
+    constexpr void apply(const GLfloat *v, GLfloat *out) const{
+        GLfloat t[4]{};
+        r.apply(v, t);
+        l.apply(t, out);
+    }
+    
+    // 式の行列の j 列目を out に求める
+    constexpr void column(int j, GLfloat *out) const{
+        GLfloat t[4]{};
+        r.column(j, t);
+        l.apply(t, out);
+    }
+};
+
+class Matrix : public MatrixExpression<Matrix>{
     GLfloat matrix[16];
 
+    // コンパイル時にも使える平方根 (ニュートン法)
+    static constexpr GLfloat constSqrt(GLfloat a){
+        if (!(a > 0.0f)) {
+            return 0.0f;
+        }
+        
+        double x(a > 1.0f ? a : 1.0), y(0.0);
+        while (x != y) {
+            y = x;
+            x = 0.5 * (x + a / x);
+            if (x >= y) break;
+        }
+        
+        return static_cast<GLfloat>(y < x ? y : x);
+    }
+    
 public:
-    Matrix(){}
+    constexpr Matrix()
+    : matrix{}{
+        
+    }
     
-    Matrix(const GLfloat *a){
-        std::copy(a, a + 16, matrix);
+    constexpr Matrix(const GLfloat *a)
+    : matrix{}{
+        for (int i = 0; i < 16; ++i) {
+            matrix[i] = a[i];
+        }
+    }
+    
+    // 行列の式を列ごとに一度だけ評価する
+    template <typename L, typename R>
+    constexpr Matrix(const MatrixProduct<L, R> &e)
+    : matrix{}{
+        for (int j = 0; j < 4; ++j) {
+            e.column(j, matrix + j * 4);
+        }
     }
     
-    const GLfloat *data() const{
+    constexpr const GLfloat *data() const{
         return matrix;
     }
     
+    constexpr void apply(const GLfloat *v, GLfloat *out) const{
+        for (int i = 0; i < 4; ++i) {
+            out[i] = matrix[i] * v[0] + matrix[4 + i] * v[1] + matrix[8 + i] * v[2] + matrix[12 + i] * v[3];
+        }
+    }
+    
+    constexpr void column(int j, GLfloat *out) const{
+        for (int i = 0; i < 4; ++i) {
+            out[i] = matrix[j * 4 + i];
+        }
+    }
+    
     // 随伴行列を転置した行列を求めている つまり p.203 の(79) 式 G　を求める
-    void getNormalMatrix(GLfloat *m) const{
+    constexpr void getNormalMatrix(GLfloat *m) const{
         m[0] = matrix[5] * matrix[10] - matrix[6] * matrix[9];
         m[1] = matrix[6] * matrix[8] - matrix[4] * matrix[10];
         m[2] = matrix[4] * matrix[9] - matrix[5] * matrix[8];
@@ -30,20 +109,69 @@ public:
         m[8] = matrix[0] * matrix[5] - matrix[1] * matrix[4];
     }
     
-    void loadIdentity(){
-        std::fill(matrix, matrix + 16, 0.0f); //行列の要素をすべて0にする
+    // 2 行ずつの小行列式から余因子を求めて逆行列を作る (正則でなければ零行列)
+    constexpr Matrix inverse() const{
+        const GLfloat *const a(matrix);
+        
+        const GLfloat s0(a[0] * a[5] - a[4] * a[1]);
+        const GLfloat s1(a[0] * a[6] - a[4] * a[2]);
+        const GLfloat s2(a[0] * a[7] - a[4] * a[3]);
+        const GLfloat s3(a[1] * a[6] - a[5] * a[2]);
+        const GLfloat s4(a[1] * a[7] - a[5] * a[3]);
+        const GLfloat s5(a[2] * a[7] - a[6] * a[3]);
+        
+        const GLfloat c5(a[10] * a[15] - a[14] * a[11]);
+        const GLfloat c4(a[9] * a[15] - a[13] * a[11]);
+        const GLfloat c3(a[9] * a[14] - a[13] * a[10]);
+        const GLfloat c2(a[8] * a[15] - a[12] * a[11]);
+        const GLfloat c1(a[8] * a[14] - a[12] * a[10]);
+        const GLfloat c0(a[8] * a[13] - a[12] * a[9]);
+        
+        const GLfloat det(s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+        
+        Matrix t;
+        if (det == 0.0f) {
+            return t;
+        }
+        const GLfloat r(1.0f / det);
+        
+        t.matrix[0] = (a[5] * c5 - a[6] * c4 + a[7] * c3) * r;
+        t.matrix[1] = (-a[1] * c5 + a[2] * c4 - a[3] * c3) * r;
+        t.matrix[2] = (a[13] * s5 - a[14] * s4 + a[15] * s3) * r;
+        t.matrix[3] = (-a[9] * s5 + a[10] * s4 - a[11] * s3) * r;
+        
+        t.matrix[4] = (-a[4] * c5 + a[6] * c2 - a[7] * c1) * r;
+        t.matrix[5] = (a[0] * c5 - a[2] * c2 + a[3] * c1) * r;
+        t.matrix[6] = (-a[12] * s5 + a[14] * s2 - a[15] * s1) * r;
+        t.matrix[7] = (a[8] * s5 - a[10] * s2 + a[11] * s1) * r;
+        
+        t.matrix[8] = (a[4] * c4 - a[5] * c2 + a[7] * c0) * r;
+        t.matrix[9] = (-a[0] * c4 + a[1] * c2 - a[3] * c0) * r;
+        t.matrix[10] = (a[12] * s4 - a[13] * s2 + a[15] * s0) * r;
+        t.matrix[11] = (-a[8] * s4 + a[9] * s2 - a[11] * s0) * r;
+        
+        t.matrix[12] = (-a[4] * c3 + a[5] * c1 - a[6] * c0) * r;
+        t.matrix[13] = (a[0] * c3 - a[1] * c1 + a[2] * c0) * r;
+        t.matrix[14] = (-a[12] * s3 + a[13] * s1 - a[14] * s0) * r;
+        t.matrix[15] = (a[8] * s3 - a[9] * s1 + a[10] * s0) * r;
+        
+        return t;
+    }
+    
+    constexpr void loadIdentity(){
+        for (GLfloat &m : matrix) m = 0.0f; //行列の要素をすべて0にする
         matrix[0] = matrix[5] = matrix[10] = matrix[15] = 1.0f; // 対角成分にだけ 1 を入れる
     }
 
     // 単位行列を作成する
-    static Matrix identity(){
+    static constexpr Matrix identity(){
         Matrix t;
         t.loadIdentity();
         return t;
     }
     
     // x,y,z だけ平行移動する変換行列を作成する
-    static Matrix translate(GLfloat x, GLfloat y, GLfloat z){
+    static constexpr Matrix translate(GLfloat x, GLfloat y, GLfloat z){
         Matrix t;
         t.loadIdentity();
         t.matrix[12] = x;
@@ -54,7 +182,7 @@ public:
     }
     
     // x, y, z 倍に拡大縮小する変換行列を作成する。
-    static Matrix scale(GLfloat x, GLfloat y, GLfloat z){
+    static constexpr Matrix scale(GLfloat x, GLfloat y, GLfloat z){
         Matrix t;
         t.loadIdentity();
         t.matrix[0] = x;
@@ -65,7 +193,7 @@ public:
     }
 
     // y軸の値に係数をかけたものをx軸に足した場合によるせん断の変換行列を作成する
-    static Matrix shear_xy(GLfloat s){
+    static constexpr Matrix shear_xy(GLfloat s){
         Matrix t;
         t.loadIdentity();
         t.matrix[4] = s;
@@ -133,7 +261,7 @@ public:
         return t;
     }
     
-    static Matrix lookat(
+    static constexpr Matrix lookat(
         GLfloat ex, GLfloat ey, GLfloat ez, //視点の位置
         GLfloat gx, GLfloat gy, GLfloat gz, //目標点の位置
         GLfloat ux, GLfloat uy, GLfloat uz // 上方向のベクトル
@@ -162,25 +290,25 @@ public:
         Matrix rv;
         rv.loadIdentity();
         
-        const GLfloat r(sqrt(rx*rx+ry*ry+rz*rz));
+        const GLfloat r(constSqrt(rx*rx+ry*ry+rz*rz));
         rv.matrix[0] = rx/r;
         rv.matrix[4] = ry/r;
         rv.matrix[8] = rz/r;
         
-        const GLfloat s(sqrt(s2));
+        const GLfloat s(constSqrt(s2));
         rv.matrix[1] = sx/s;
         rv.matrix[5] = sy/s;
         rv.matrix[9] = sz/s;
         
-        const GLfloat t(sqrt(tx*tx+ty*ty+tz*tz));
+        const GLfloat t(constSqrt(tx*tx+ty*ty+tz*tz));
         rv.matrix[2] = tx/t;
         rv.matrix[6] = ty/t;
         rv.matrix[10] = tz/t;
 
-        return rv * tv;
+        return Matrix(MatrixProduct<Matrix, Matrix>(rv, tv));
     }
     
-    static Matrix orthogonal(
+    static constexpr Matrix orthogonal(
         GLfloat left, GLfloat right,
         GLfloat bottom, GLfloat top,
         GLfloat zNear, GLfloat zFar
@@ -203,7 +331,7 @@ public:
         return t;
     }
     
-    static Matrix frustum(
+    static constexpr Matrix frustum(
       GLfloat left, GLfloat right,
       GLfloat bottom, GLfloat top,
       GLfloat zNear, GLfloat zFar
@@ -244,21 +372,16 @@ public:
         
         return t;
     }
-    
-    Matrix operator*(const Matrix&m) const{
-        Matrix t;
-        
-        for (int j = 0; j < 4; j++) {
-            for (int i = 0; i < 4; i++) {
-                const int ji(j*4+i);
-                
-                t.matrix[ji] = 0.0f;
-                for (int k = 0; k < 4; k++) {
-                    t.matrix[ji] += matrix[k*4+i] * m.matrix[j*4+k];
-                }
-            }
-        }
-        
-        return t;
-    }
 };
+
+// 積の項として持つ型. 左辺値は参照し, 一時的なものは値で写す
+template <typename T>
+using MatrixOperand = typename std::conditional<std::is_lvalue_reference<T>::value,
+    const typename std::decay<T>::type &, typename std::decay<T>::type>::type;
+
+template <typename L, typename R, typename = typename std::enable_if<
+    std::is_base_of<MatrixExpression<typename std::decay<L>::type>, typename std::decay<L>::type>::value &&
+    std::is_base_of<MatrixExpression<typename std::decay<R>::type>, typename std::decay<R>::type>::value>::type>
+constexpr MatrixProduct<MatrixOperand<L>, MatrixOperand<R>> operator*(L &&l, R &&r){
+    return MatrixProduct<MatrixOperand<L>, MatrixOperand<R>>(l, r);
+}
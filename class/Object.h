@@ -1,10 +1,30 @@
 #pragma once
+#include <algorithm>
+#include <vector>
 #include <GL/glew.h>
+#include "../gltrace.hpp"
+#include "../log.hpp"
+#include "../meshcodec.hpp"
+#include "ResourcePool.h"
 
-class Object{
-    GLuint vao;
-    GLuint vbo;
-    GLuint ibo;
+// 作ったときの頂点と指標の写しを CPU に残しておき, ResourcePool の予算を超えると GPU のバッファだけを手放して追い出され,
+// 次に bind() したときに写しから作り直す
+class Object : public ResourcePool::Evictable{
+    // 追い出している間は 0
+    mutable GLuint vao;
+    mutable ResourcePool::Buffer vbo;
+    mutable ResourcePool::Buffer ibo;
+    
+    const GLint size;
+    const GLsizeiptr vertexBytes, indexBytes;
+    
+    // 圧縮した頂点か指標を展開できなかったら true. バッファの中身は不定なので描かない
+    bool failed;
+    
+    // 作り直すための頂点と指標の写し. 圧縮して渡されたときは圧縮したまま encoded に持つ
+    const bool compressed;
+    std::vector<unsigned char> copy;
+    EncodedMesh encoded;
     
 public:
     struct Vertex{
@@ -12,28 +32,104 @@ public:
         GLfloat normal[3];
     };
     
-    Object(GLint size, GLsizei vertexcount, const Vertex *vertex, GLsizei indexcount = 0, const GLuint *index = NULL){
-        glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
-        
-        glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, vertexcount * sizeof(Vertex), vertex, GL_STATIC_DRAW);
-        
+private:
+    // 結合している頂点配列オブジェクトに vbo の頂点属性を設定する
+    void setAttributes() const{
         glVertexAttribPointer(0, size, GL_FLOAT, GL_FALSE, sizeof(Vertex), static_cast<Vertex *>(0)->position);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), static_cast<Vertex *>(0)->normal);
         glEnableVertexAttribArray(1);
-
-        glGenBuffers(1, &ibo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexcount * sizeof(GLuint), index, GL_STATIC_DRAW);
     }
     
+    // 写しから頂点配列オブジェクトとバッファを作る
+    // 圧縮したものは中身を渡さずに確保したバッファをマップして直接展開し, 展開できなければ false を返す
+    bool create() const{
+        ResourcePool &pool(ResourcePool::instance());
+        
+        vao = pool.createVertexArray();
+        
+        if (!compressed) {
+            vbo = pool.createBuffer(GL_ARRAY_BUFFER, vertexBytes, copy.data());
+            setAttributes();
+            ibo = pool.createBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBytes, copy.data() + vertexBytes);
+            return true;
+        }
+        
+        bool decoded(true);
+        
+        vbo = pool.createBuffer(GL_ARRAY_BUFFER, vertexBytes, NULL);
+        if (vertexBytes > 0) {
+            void *const p(glMapBufferRange(GL_ARRAY_BUFFER, 0, vertexBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT));
+            if (p == NULL || !decodeVertexBuffer(encoded.vertex.data(), encoded.vertex.size(), p, encoded.vertexcount, sizeof(Vertex))) {
+                logMessage(LOG_ERROR, LOG_RESOURCE, "could not decode vertex buffer ({} vertices)", encoded.vertexcount);
+                decoded = false;
+            }
+            if (p != NULL) glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        
+        setAttributes();
+        
+        ibo = pool.createBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBytes, NULL);
+        if (indexBytes > 0) {
+            void *const p(glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, indexBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT));
+            if (p == NULL || !decodeIndexBuffer(encoded.index.data(), encoded.index.size(), static_cast<GLuint *>(p), encoded.indexcount)) {
+                logMessage(LOG_ERROR, LOG_RESOURCE, "could not decode index buffer ({} indices)", encoded.indexcount);
+                decoded = false;
+            }
+            if (p != NULL) glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+        }
+        
+        return decoded;
+    }
+    
+    // 写しは作ったときから持っているので GPU から読み戻さずに手放すだけにする
+    virtual void evict() const{
+        ResourcePool &pool(ResourcePool::instance());
+        pool.releaseVertexArray(vao);
+        pool.discardBuffer(vbo);
+        pool.discardBuffer(ibo);
+        
+        const ResourcePool::Buffer empty = { 0, 0 };
+        vao = 0;
+        vbo = ibo = empty;
+    }
+    
+    virtual void restore() const{
+        create();
+    }
+    
+    virtual size_t residentBytes() const{
+        return vbo.capacity + ibo.capacity;
+    }
+    
+public:
+    Object(GLint size, GLsizei vertexcount, const Vertex *vertex, GLsizei indexcount = 0, const GLuint *index = NULL)
+    : size(size), vertexBytes(vertexcount * sizeof(Vertex)), indexBytes(indexcount * sizeof(GLuint)), failed(false)
+    , compressed(false), copy(vertexBytes + indexBytes){
+        if (vertex != NULL) {
+            std::copy_n(reinterpret_cast<const unsigned char *>(vertex), vertexBytes, copy.begin());
+        }
+        if (index != NULL) {
+            std::copy_n(reinterpret_cast<const unsigned char *>(index), indexBytes, copy.begin() + vertexBytes);
+        }
+        
+        create();
+    }
+    
+    // 圧縮した頂点と指標は圧縮したまま写しに持ち, 確保したバッファに直接展開する
+    // 展開できなければ valid() が false になり, Shape は何も描かない
+    Object(GLint size, const EncodedMesh &mesh)
+    : size(size), vertexBytes(mesh.vertexcount * sizeof(Vertex)), indexBytes(mesh.indexcount * sizeof(GLuint)), failed(false)
+    , compressed(true), encoded(mesh){
+        failed = !create();
+    }
+    
+    // GPU が使い終わるまで再利用しないように ResourcePool に返す
     virtual ~Object(){
-        glDeleteVertexArrays(1, &vao);
-        glDeleteBuffers(1, &vbo);
-        glDeleteBuffers(1, &ibo);
+        ResourcePool &pool(ResourcePool::instance());
+        pool.releaseVertexArray(vao);
+        pool.releaseBuffer(vbo);
+        pool.releaseBuffer(ibo);
     }
     
 private:
@@ -41,7 +137,17 @@ private:
     Object &operator=(const Object &o);
     
 public:
+    // 描ける中身があれば true
+    bool valid() const{
+        return !failed;
+    }
+    
     void bind() const{
+        ResourcePool &pool(ResourcePool::instance());
+        pool.use(*this);
+        pool.touch(vbo);
+        pool.touch(ibo);
+        
         glBindVertexArray(vao);
     }
 };
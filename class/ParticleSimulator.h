@@ -0,0 +1,161 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <GL/glew.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+#include "ThreadPool.h"
+
+// 粒子の動きの設定 (particle_update.vert のユニフォーム変数と同じ意味)
+struct ParticleParameters{
+    static constexpr int maxEmitters = 4;
+    
+    // 放出する位置と初速度の大きさ
+    struct Emitter{
+        GLfloat position[3];
+        GLfloat speed;
+    };
+    
+    Emitter emitter[maxEmitters];
+    int emitterCount;
+    GLfloat gravity[3];
+    GLfloat drag;
+    GLfloat lifetime;
+};
+
+// particle_update.vert と同じ計算を CPU で行う. GPU が使えないときの代わりと結果の確認に使う
+// 各成分を別の配列に置き (SoA), 4 個ずつ SIMD で計算する
+class ParticleSimulator{
+    const size_t count;
+    
+    // 位置と経過時間, 速度と大きさの係数
+    std::vector<GLfloat> px, py, pz, age;
+    std::vector<GLfloat> vx, vy, vz, size;
+    
+public:
+    // particle_update.vert の random() と同じ擬似乱数
+    static GLfloat random(uint32_t x){
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return static_cast<GLfloat>(x) * (1.0f / 4294967295.0f);
+    }
+    
+    // 最初は経過時間を負にして lifetime の間にばらばらに生まれるようにする
+    static GLfloat initialAge(size_t i, GLfloat lifetime){
+        return -random(static_cast<uint32_t>(i) * 4u + 0x9e3779b9u) * lifetime;
+    }
+    
+    ParticleSimulator(size_t count, const ParticleParameters &p)
+    : count(count)
+    , px(count), py(count), pz(count), age(count)
+    , vx(count), vy(count), vz(count), size(count, 1.0f){
+        for (size_t i = 0; i < count; ++i) {
+            const ParticleParameters::Emitter &e(p.emitter[i % p.emitterCount]);
+            px[i] = e.position[0];
+            py[i] = e.position[1];
+            pz[i] = e.position[2];
+            age[i] = initialAge(i, p.lifetime);
+        }
+    }
+    
+    size_t getCount() const{
+        return count;
+    }
+    
+    // dt 秒進める. frame は particle_update.vert の frame と同じ値
+    void step(const ParticleParameters &p, GLfloat dt, int frame, ThreadPool &pool){
+        pool.parallel(count, 16384, [&](size_t begin, size_t end){
+            integrate(p, dt, begin, end);
+            respawn(p, frame, begin, end);
+        });
+    }
+    
+    // i 番目の粒子を particle_update.vert の入力と同じ並び (位置と経過時間, 速度と大きさ) で書き出す
+    void get(size_t begin, size_t end, GLfloat *out) const{
+        for (size_t i = begin; i < end; ++i, out += 8) {
+            out[0] = px[i]; out[1] = py[i]; out[2] = pz[i]; out[3] = age[i];
+            out[4] = vx[i]; out[5] = vy[i]; out[6] = vz[i]; out[7] = size[i];
+        }
+    }
+    
+private:
+    // 生きている粒子を動かし, すべての粒子の経過時間を進める
+    void integrate(const ParticleParameters &p, GLfloat dt, size_t begin, size_t end){
+        const GLfloat k(std::max(1.0f - p.drag * dt, 0.0f));
+        const GLfloat gx(p.gravity[0] * dt), gy(p.gravity[1] * dt), gz(p.gravity[2] * dt);
+        
+        size_t i(begin);
+        
+#if defined(__SSE__)
+        const __m128 vdt(_mm_set1_ps(dt)), vk(_mm_set1_ps(k)), vlife(_mm_set1_ps(p.lifetime));
+        const __m128 vgx(_mm_set1_ps(gx)), vgy(_mm_set1_ps(gy)), vgz(_mm_set1_ps(gz));
+        const __m128 zero(_mm_setzero_ps());
+        
+        for (; i + 4 <= end; i += 4) {
+            const __m128 a(_mm_add_ps(_mm_loadu_ps(&age[i]), vdt));
+            _mm_storeu_ps(&age[i], a);
+            
+            // 生きている粒子だけ更新する
+            const __m128 alive(_mm_and_ps(_mm_cmpge_ps(a, zero), _mm_cmplt_ps(a, vlife)));
+            
+            const __m128 nx(_mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&vx[i]), vgx), vk));
+            const __m128 ny(_mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&vy[i]), vgy), vk));
+            const __m128 nz(_mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&vz[i]), vgz), vk));
+            
+            const __m128 ox(_mm_loadu_ps(&vx[i])), oy(_mm_loadu_ps(&vy[i])), oz(_mm_loadu_ps(&vz[i]));
+            _mm_storeu_ps(&vx[i], _mm_or_ps(_mm_and_ps(alive, nx), _mm_andnot_ps(alive, ox)));
+            _mm_storeu_ps(&vy[i], _mm_or_ps(_mm_and_ps(alive, ny), _mm_andnot_ps(alive, oy)));
+            _mm_storeu_ps(&vz[i], _mm_or_ps(_mm_and_ps(alive, nz), _mm_andnot_ps(alive, oz)));
+            
+            _mm_storeu_ps(&px[i], _mm_add_ps(_mm_loadu_ps(&px[i]), _mm_and_ps(alive, _mm_mul_ps(nx, vdt))));
+            _mm_storeu_ps(&py[i], _mm_add_ps(_mm_loadu_ps(&py[i]), _mm_and_ps(alive, _mm_mul_ps(ny, vdt))));
+            _mm_storeu_ps(&pz[i], _mm_add_ps(_mm_loadu_ps(&pz[i]), _mm_and_ps(alive, _mm_mul_ps(nz, vdt))));
+        }
+#endif
+        
+        for (; i < end; ++i) {
+            age[i] += dt;
+            if (age[i] >= 0.0f && age[i] < p.lifetime) {
+                vx[i] = (vx[i] + gx) * k;
+                vy[i] = (vy[i] + gy) * k;
+                vz[i] = (vz[i] + gz) * k;
+                px[i] += vx[i] * dt;
+                py[i] += vy[i] * dt;
+                pz[i] += vz[i] * dt;
+            }
+        }
+    }
+    
+    // 寿命が尽きた粒子を放出位置に戻す
+    void respawn(const ParticleParameters &p, int frame, size_t begin, size_t end){
+        for (size_t i = begin; i < end; ++i) {
+            if (age[i] < p.lifetime) {
+                continue;
+            }
+            
+            const uint32_t seed(static_cast<uint32_t>(i) * 4u + static_cast<uint32_t>(frame) * 2654435761u);
+            const ParticleParameters::Emitter &e(p.emitter[i % p.emitterCount]);
+            
+            GLfloat dx(random(seed) * 2.0f - 1.0f);
+            GLfloat dy(random(seed + 1u) + 0.5f);
+            GLfloat dz(random(seed + 2u) * 2.0f - 1.0f);
+            const GLfloat l(e.speed / std::sqrt(dx * dx + dy * dy + dz * dz));
+            
+            px[i] = e.position[0];
+            py[i] = e.position[1];
+            pz[i] = e.position[2];
+            age[i] -= p.lifetime;
+            vx[i] = dx * l;
+            vy[i] = dy * l;
+            vz[i] = dz * l;
+            size[i] = 0.5f + random(seed + 3u);
+        }
+    }
+};
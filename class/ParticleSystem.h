@@ -0,0 +1,182 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <GL/glew.h>
+#include "../gltrace.hpp"
+#include "../load_window.hpp"
+#include "Matrix.h"
+#include "ParticleSimulator.h"
+#include "Program.h"
+#include "ResourcePool.h"
+#include "ThreadPool.h"
+
+// Transform Feedback で粒子を GPU 上で動かし, 点スプライトで描く
+// 二つのバッファを交互に入力と出力に使う
+class ParticleSystem{
+    // 1 個の粒子は位置と経過時間, 速度と大きさの係数の vec4 二つ
+    static constexpr GLsizeiptr stride = 8 * sizeof(GLfloat);
+    
+    const GLsizei count;
+    
+    GLuint vao[2];
+    ResourcePool::Buffer vbo[2];
+    
+    // 今の状態が入っている方
+    int source;
+    
+    int frame;
+    
+    Program update;
+    Program render;
+    
+    Program::Variable<GLfloat> dtLoc, lifetimeLoc, dragLoc;
+    Program::Variable<std::array<GLfloat, 3>> gravityLoc;
+    Program::Variable<std::array<GLfloat, 4>> emitterLoc;
+    Program::Variable<GLint> emitterCountLoc, frameLoc;
+    
+    Program::Variable<Matrix> modelviewLoc, projectionLoc;
+    Program::Variable<GLfloat> renderLifetimeLoc, pointSizeLoc;
+    Program::Variable<std::array<GLfloat, 3>> colorLoc;
+    
+    static const char *const *varyings(){
+        static const char *const names[] = { "nextPosition", "nextVelocity" };
+        return names;
+    }
+    
+public:
+    ParticleSystem(GLsizei count, const ParticleParameters &p)
+    : count(count), source(0), frame(0)
+    , update(loadProgram("particle_update.vert", NULL, varyings(), 2))
+    , render(loadProgram("particle.vert", "particle.frag"))
+    , dtLoc(update.uniform<GLfloat>("dt"))
+    , lifetimeLoc(update.uniform<GLfloat>("lifetime"))
+    , dragLoc(update.uniform<GLfloat>("drag"))
+    , gravityLoc(update.uniform<std::array<GLfloat, 3>>("gravity"))
+    , emitterLoc(update.uniform<std::array<GLfloat, 4>>("emitter"))
+    , emitterCountLoc(update.uniform<GLint>("emitterCount"))
+    , frameLoc(update.uniform<GLint>("frame"))
+    , modelviewLoc(render.uniform<Matrix>("modelview"))
+    , projectionLoc(render.uniform<Matrix>("projection"))
+    , renderLifetimeLoc(render.uniform<GLfloat>("lifetime"))
+    , pointSizeLoc(render.uniform<GLfloat>("pointSize"))
+    , colorLoc(render.uniform<std::array<GLfloat, 3>>("color")){
+        // 最初は放出位置に置いて lifetime の間にばらばらに生まれるようにする
+        std::vector<GLfloat> initial(static_cast<size_t>(count) * 8, 0.0f);
+        for (GLsizei i = 0; i < count; ++i) {
+            const ParticleParameters::Emitter &e(p.emitter[i % p.emitterCount]);
+            GLfloat *const v(&initial[static_cast<size_t>(i) * 8]);
+            v[0] = e.position[0];
+            v[1] = e.position[1];
+            v[2] = e.position[2];
+            v[3] = ParticleSimulator::initialAge(i, p.lifetime);
+            v[7] = 1.0f;
+        }
+        
+        ResourcePool &pool(ResourcePool::instance());
+        
+        for (int i = 0; i < 2; ++i) {
+            vao[i] = pool.createVertexArray();
+            vbo[i] = pool.createBuffer(GL_ARRAY_BUFFER, count * stride, initial.data(), GL_DYNAMIC_COPY);
+            
+            // 頂点属性の場所は createProgram() が position を 0, velocity を 1 にしている
+            glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, 0);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, static_cast<GLfloat *>(0) + 4);
+            glEnableVertexAttribArray(1);
+        }
+    }
+    
+    virtual ~ParticleSystem(){
+        ResourcePool &pool(ResourcePool::instance());
+        for (int i = 0; i < 2; ++i) {
+            pool.releaseVertexArray(vao[i]);
+            pool.releaseBuffer(vbo[i]);
+        }
+    }
+    
+private:
+    ParticleSystem(const ParticleSystem &s);
+    ParticleSystem &operator=(const ParticleSystem &s);
+    
+public:
+    GLsizei getCount() const{
+        return count;
+    }
+    
+    // 今の状態を particle_update.vert の入力と同じ並びで out に読み出す
+    // GPU の処理を待つので ParticleSimulator の結果と比べるときだけ使う
+    void read(GLfloat *out) const{
+        glBindBuffer(GL_ARRAY_BUFFER, vbo[source].name);
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, count * stride, out);
+    }
+    
+    // GPU で dt 秒進める
+    void step(const ParticleParameters &p, GLfloat dt){
+        update.use();
+        update.set(dtLoc, dt);
+        update.set(lifetimeLoc, p.lifetime);
+        update.set(dragLoc, p.drag);
+        update.set(gravityLoc, std::array<GLfloat, 3>{ p.gravity[0], p.gravity[1], p.gravity[2] });
+        update.set(emitterLoc, reinterpret_cast<const std::array<GLfloat, 4> *>(p.emitter), p.emitterCount);
+        update.set(emitterCountLoc, static_cast<GLint>(p.emitterCount));
+        update.set(frameLoc, static_cast<GLint>(frame++));
+        
+        ResourcePool &pool(ResourcePool::instance());
+        pool.touch(vbo[source]);
+        pool.touch(vbo[1 - source]);
+        
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBindVertexArray(vao[source]);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, vbo[1 - source].name);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, count);
+        glEndTransformFeedback();
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glDisable(GL_RASTERIZER_DISCARD);
+        
+        source = 1 - source;
+    }
+    
+    // CPU で dt 秒進めて結果をバッファに書き込む
+    void step(const ParticleParameters &p, GLfloat dt, ParticleSimulator &simulator, ThreadPool &pool){
+        simulator.step(p, dt, frame++, pool);
+        
+        // 描画中のバッファを待たないように新しい領域に置き換えて書き込む
+        glBindBuffer(GL_ARRAY_BUFFER, vbo[source].name);
+        glBufferData(GL_ARRAY_BUFFER, vbo[source].capacity, NULL, GL_DYNAMIC_COPY);
+        GLfloat *const out(static_cast<GLfloat *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, count * stride,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT)));
+        
+        if (out != NULL) {
+            const ParticleSimulator &s(simulator);
+            pool.parallel(count, 16384, [&](size_t begin, size_t end){
+                s.get(begin, end, out + begin * 8);
+            });
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+    }
+    
+    // 加算合成の点スプライトで描く
+    void draw(const Matrix &projection, const Matrix &modelview, const ParticleParameters &p,
+              GLfloat pointSize, const std::array<GLfloat, 3> &color){
+        render.use();
+        render.set(projectionLoc, projection);
+        render.set(modelviewLoc, modelview);
+        render.set(renderLifetimeLoc, p.lifetime);
+        render.set(pointSizeLoc, pointSize);
+        render.set(colorLoc, color);
+        
+        glEnable(GL_PROGRAM_POINT_SIZE);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+        glDepthMask(GL_FALSE);
+        
+        ResourcePool::instance().touch(vbo[source]);
+        glBindVertexArray(vao[source]);
+        glDrawArrays(GL_POINTS, 0, count);
+        
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+        glDisable(GL_PROGRAM_POINT_SIZE);
+    }
+};
@@ -0,0 +1,130 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include <GL/glew.h>
+#include "BVH.h"
+#include "Matrix.h"
+#include "Ray.h"
+#include "ThreadPool.h"
+#include "TriangleBVH.h"
+
+// 形状をモデル変換して置いたものの集まりに対する光線の交差
+// 置いたものの箱で上の BVH を作り, 葉では光線をモデル座標に戻して形状の BVH を辿る
+class Picker{
+    struct Instance{
+        const TriangleBVH *mesh;
+        Matrix model;
+        Matrix inverse;
+    };
+    
+    std::vector<Instance> instances;
+    std::vector<BVH::Bounds> boxes;
+    BVH bvh;
+    
+    // 前の build() から置いたものが増えたか動いたら true
+    bool changed;
+    
+    // モデル変換した箱の 8 つの角を囲む箱
+    static BVH::Bounds transform(const BVH::Bounds &b, const Matrix &m){
+        BVH::Bounds t(BVH::Bounds::empty());
+        for (int i = 0; i < 8; ++i) {
+            const GLfloat v[4] = { (i & 1) ? b.max[0] : b.min[0], (i & 2) ? b.max[1] : b.min[1], (i & 4) ? b.max[2] : b.min[2], 1.0f };
+            GLfloat w[4];
+            m.apply(v, w);
+            t.grow(w);
+        }
+        return t;
+    }
+
+public:
+    Picker()
+    : changed(false){
+    
+    }
+    
+    virtual ~Picker(){
+    
+    }
+
+private:
+    Picker(const Picker &p);
+    Picker &operator=(const Picker &p);
+
+public:
+    // mesh を model で置き, 番号を返す. mesh は Picker より長く生きていなければならない
+    GLint add(const TriangleBVH &mesh, const Matrix &model){
+        const Instance instance = { &mesh, model, model.inverse() };
+        instances.push_back(instance);
+        boxes.push_back(transform(mesh.bounds(), model));
+        changed = true;
+        return static_cast<GLint>(instances.size()) - 1;
+    }
+    
+    // 動かしたら build() し直す. 前と同じ行列なら何もしない
+    void setModel(GLint i, const Matrix &model){
+        Instance &instance(instances[i]);
+        if (std::equal(model.data(), model.data() + 16, instance.model.data())) {
+            return;
+        }
+        
+        instance.model = model;
+        instance.inverse = model.inverse();
+        boxes[i] = transform(instance.mesh->bounds(), model);
+        changed = true;
+    }
+    
+    // add() か setModel() で変わったときだけ作り直す
+    void build(ThreadPool *pool = NULL){
+        if (!changed) {
+            return;
+        }
+        
+        bvh.build(boxes, pool);
+        changed = false;
+    }
+    
+    // 最も近い交差を求める. 当たらなければ hit.instance は -1
+    bool pick(const Ray &ray, Hit &hit) const{
+        hit = Hit::none();
+        
+        bvh.intersect(ray, hit, [&](uint32_t i){
+            const GLuint n(bvh.getOrder()[i]);
+            const Instance &instance(instances[n]);
+            
+            // 方向も同じ行列で変換するので t はワールド座標と同じ値になる
+            if (instance.mesh->intersect(ray.transform(instance.inverse), hit)) {
+                hit.instance = static_cast<GLint>(n);
+            }
+        });
+        
+        return hit.instance >= 0;
+    }
+    
+    // 4 本の光線の交差をまとめて求める. 当たった光線のビットを返す
+    int pick(const Ray *ray, Hit *hit) const{
+        for (int k = 0; k < 4; ++k) {
+            hit[k] = Hit::none();
+        }
+        
+        bvh.intersect(ray, hit, [&](uint32_t i, int){
+            const GLuint n(bvh.getOrder()[i]);
+            const Instance &instance(instances[n]);
+            
+            const Ray local[4] = {
+                ray[0].transform(instance.inverse), ray[1].transform(instance.inverse),
+                ray[2].transform(instance.inverse), ray[3].transform(instance.inverse)
+            };
+            
+            const int m(instance.mesh->intersect(local, hit));
+            for (int k = 0; k < 4; ++k) {
+                if (m & (1 << k)) hit[k].instance = static_cast<GLint>(n);
+            }
+        });
+        
+        int result(0);
+        for (int k = 0; k < 4; ++k) {
+            if (hit[k].instance >= 0) result |= 1 << k;
+        }
+        return result;
+    }
+};
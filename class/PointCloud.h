@@ -0,0 +1,421 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <GL/glew.h>
+#include "../gltrace.hpp"
+#include "../load_window.hpp"
+#include "../log.hpp"
+#include "FrameArena.h"
+#include "Matrix.h"
+#include "Program.h"
+#include "ResourcePool.h"
+
+// buildPointCloud() で作った八分木を, 画面上の誤差が大きい節点から点の数の上限まで選んで描く
+// 節点の点はメモリに割り当てたファイルから別のスレッドで読み込み, 1 フレームに少しずつ GPU に送る
+class PointCloud{
+public:
+    // ファイルに書かれた 1 個の点
+    struct Point{
+        GLfloat position[3];
+        GLubyte color[4];
+    };
+    
+    // 八分木の節点. 節点の点は子の点と重ならない間引いた点
+    struct Node{
+        // 立方体の最小の角と一辺の長さ
+        GLfloat min[3];
+        GLfloat size;
+        
+        // points.bin の中の最初の点の番号と数
+        uint64_t first;
+        uint32_t count;
+        
+        // 子の節点の番号 (なければ -1)
+        int32_t child[8];
+    };
+    
+    static constexpr uint32_t magic = 0x544f4350;  // "PCOT"
+    
+private:
+    enum State{ EMPTY, REQUESTED, RESIDENT };
+    
+    struct Resident{
+        State state;
+        ResourcePool::Buffer buffer;
+        unsigned long used;
+        
+        // GPU にある節点を最後に使った順につなぐ (端は -1)
+        int newer, older;
+    };
+    
+    struct Loaded{
+        int node;
+        std::vector<Point> points;
+    };
+    
+    std::vector<Node> nodes;
+    std::vector<Resident> resident;
+    
+    // points.bin を割り当てたメモリ
+    const Point *data;
+    size_t length;
+    
+    // 読み込みスレッドとのやり取り
+    std::mutex mutex;
+    std::condition_variable wake;
+    // 読み込みを頼んだ節点. update() のたびに作り直し, 読み込みスレッドは requestHead から順に取る
+    std::vector<int> requests;
+    size_t requestHead;
+    std::deque<Loaded> loaded;
+    bool stopping;
+    std::thread loader;
+    
+    // 最後の update() で選んだ節点. 節点の数だけ確保しておくので毎フレーム確保しない
+    std::vector<int> selected;
+    
+    unsigned long frame;
+    size_t residentPoints;
+    
+    // GPU にある節点のうち最後に使ったものと一番前に使ったもの
+    int newest, oldest;
+    
+    GLuint vao;
+    Program program;
+    Program::Variable<Matrix> modelviewLoc, projectionLoc;
+    Program::Variable<GLfloat> spacingLoc, scaleLoc;
+    GLint colorAttrib;
+    
+    void load(){
+        std::unique_lock<std::mutex> lock(mutex);
+        
+        for (;;) {
+            wake.wait(lock, [&]{ return stopping || requestHead < requests.size(); });
+            if (stopping) {
+                return;
+            }
+            
+            const int n(requests[requestHead++]);
+            lock.unlock();
+            
+            // ページの読み込みはこのスレッドで起こす
+            Loaded l;
+            l.node = n;
+            const Point *const p(data + nodes[n].first);
+            l.points.assign(p, p + nodes[n].count);
+            
+            lock.lock();
+            loaded.push_back(std::move(l));
+        }
+    }
+    
+    // GPU にある節点の列から n を外す
+    void unlink(int n){
+        Resident &r(resident[n]);
+        (r.newer >= 0 ? resident[r.newer].older : newest) = r.older;
+        (r.older >= 0 ? resident[r.older].newer : oldest) = r.newer;
+        r.newer = r.older = -1;
+    }
+    
+    // GPU にある節点の列の最後に使った側に n をつなぐ
+    void pushNewest(int n){
+        Resident &r(resident[n]);
+        r.newer = -1;
+        r.older = newest;
+        (newest >= 0 ? resident[newest].newer : oldest) = n;
+        newest = n;
+    }
+    
+    // 節点の立方体が視錐台の外にあれば true
+    static bool outside(const Node &n, const Matrix &mvp){
+        int out[6] = {};
+        
+        for (int i = 0; i < 8; ++i) {
+            const GLfloat v[4] = {
+                n.min[0] + ((i & 1) ? n.size : 0.0f),
+                n.min[1] + ((i & 2) ? n.size : 0.0f),
+                n.min[2] + ((i & 4) ? n.size : 0.0f),
+                1.0f
+            };
+            GLfloat c[4];
+            mvp.apply(v, c);
+            
+            out[0] += c[0] < -c[3];
+            out[1] += c[0] > c[3];
+            out[2] += c[1] < -c[3];
+            out[3] += c[1] > c[3];
+            out[4] += c[2] < -c[3];
+            out[5] += c[2] > c[3];
+        }
+        
+        return std::find(out, out + 6, 8) != out + 6;
+    }
+    
+public:
+    // directory は buildPointCloud() の出力先
+    explicit PointCloud(const std::string &directory)
+    : data(NULL), length(0), requestHead(0), stopping(false), frame(0), residentPoints(0), newest(-1), oldest(-1)
+    , vao(ResourcePool::instance().createVertexArray())
+    , program(loadProgram("pointcloud.vert", "pointcloud.frag"))
+    , modelviewLoc(program.uniform<Matrix>("modelview"))
+    , projectionLoc(program.uniform<Matrix>("projection"))
+    , spacingLoc(program.uniform<GLfloat>("spacing"))
+    , scaleLoc(program.uniform<GLfloat>("scale"))
+    , colorAttrib(glGetAttribLocation(program.get(), "color")){
+        std::ifstream file(directory + "/hierarchy.bin", std::ios::binary);
+        uint32_t header[2] = {};
+        file.read(reinterpret_cast<char *>(header), sizeof header);
+        if (file.fail() || header[0] != magic) {
+            logMessage(LOG_ERROR, LOG_RESOURCE, "cant read point cloud hierarchy: {}", directory);
+            return;
+        }
+        
+        nodes.resize(header[1]);
+        file.read(reinterpret_cast<char *>(nodes.data()), nodes.size() * sizeof(Node));
+        if (file.fail()) {
+            logMessage(LOG_ERROR, LOG_RESOURCE, "could not read point cloud hierarchy: {}", directory);
+            nodes.clear();
+            return;
+        }
+        
+        const std::string points(directory + "/points.bin");
+        const int fd(open(points.c_str(), O_RDONLY));
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+            logMessage(LOG_ERROR, LOG_RESOURCE, "cant open point cloud data: {}", points);
+            if (fd >= 0) close(fd);
+            nodes.clear();
+            return;
+        }
+        
+        length = static_cast<size_t>(st.st_size);
+        void *const m(mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0));
+        close(fd);
+        if (m == MAP_FAILED) {
+            logMessage(LOG_ERROR, LOG_RESOURCE, "cant map point cloud data: {}", points);
+            nodes.clear();
+            length = 0;
+            return;
+        }
+        data = static_cast<const Point *>(m);
+        
+        // 節点の点がファイルの中にあり, 子の番号が節点の数より小さいことを確かめる
+        const uint64_t available(length / sizeof(Point));
+        for (const Node &n : nodes) {
+            bool valid(n.first <= available && n.count <= available - n.first);
+            for (int c : n.child) {
+                valid = valid && c < static_cast<int32_t>(nodes.size());
+            }
+            if (!valid) {
+                logMessage(LOG_ERROR, LOG_RESOURCE, "point cloud hierarchy does not match its data: {}", directory);
+                munmap(m, length);
+                data = NULL;
+                length = 0;
+                nodes.clear();
+                return;
+            }
+        }
+        
+        const Resident empty = { EMPTY, { 0, 0 }, 0, -1, -1 };
+        resident.assign(nodes.size(), empty);
+        requests.reserve(nodes.size());
+        selected.reserve(nodes.size());
+        
+        loader = std::thread(&PointCloud::load, this);
+    }
+    
+    virtual ~PointCloud(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (loader.joinable()) {
+            loader.join();
+        }
+        
+        ResourcePool &pool(ResourcePool::instance());
+        for (Resident &r : resident) {
+            pool.releaseBuffer(r.buffer);
+        }
+        pool.releaseVertexArray(vao);
+        
+        if (data != NULL) {
+            munmap(const_cast<Point *>(data), length);
+        }
+    }
+    
+private:
+    PointCloud(const PointCloud &p);
+    PointCloud &operator=(const PointCloud &p);
+    
+public:
+    // 読み込めたときは八分木の根の立方体
+    const Node *root() const{
+        return nodes.empty() ? NULL : &nodes[0];
+    }
+    
+    // 描く節点を選び直し, 読み込みを頼み, 読み込めた節点を GPU に送る
+    // height はビューポートの高さ [画素], threshold は細かくする画面上の点の間隔 [画素]
+    // budget は描く点と GPU に置いておく点の数の上限, uploadBudget は 1 フレームに GPU に送る点の数の上限
+    void update(const Matrix &projection, const Matrix &modelview, GLfloat height,
+                GLfloat threshold = 2.0f, size_t budget = 5000000, size_t uploadBudget = 500000){
+        if (nodes.empty()) {
+            return;
+        }
+        ++frame;
+        
+        ResourcePool &pool(ResourcePool::instance());
+        
+        // 読み込めた節点を少しずつ GPU に送る
+        for (size_t uploaded(0); uploaded < uploadBudget;) {
+            Loaded l;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (loaded.empty()) break;
+                l = std::move(loaded.front());
+                loaded.pop_front();
+            }
+            
+            Resident &r(resident[l.node]);
+            r.buffer = pool.createBuffer(GL_ARRAY_BUFFER, l.points.size() * sizeof(Point), l.points.data());
+            r.state = RESIDENT;
+            pushNewest(l.node);
+            residentPoints += l.points.size();
+            uploaded += l.points.size();
+        }
+        
+        // 画面上の点の間隔が大きい節点から選ぶ
+        const Matrix mvp(projection * modelview);
+        const GLfloat *const mv(modelview.data());
+        const GLfloat unit(std::sqrt(mv[0] * mv[0] + mv[1] * mv[1] + mv[2] * mv[2]));
+        const GLfloat pixels(projection.data()[5] * height * 0.5f);
+        
+        // 選ぶときに使う (画面上の誤差, 節点の番号) のヒープはこのフレームの間だけ使う
+        selected.clear();
+        
+        std::vector<std::pair<GLfloat, int>, ArenaAllocator<std::pair<GLfloat, int>>> heap;
+        heap.reserve(nodes.size());
+        heap.emplace_back(1.0e30f, 0);
+        
+        size_t points(0);
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end());
+            const std::pair<GLfloat, int> top(heap.back());
+            heap.pop_back();
+            
+            const Node &n(nodes[top.second]);
+            if (top.first < threshold || points + n.count > budget) {
+                break;
+            }
+            
+            selected.push_back(top.second);
+            points += n.count;
+            
+            for (int c : n.child) {
+                if (c < 0 || outside(nodes[c], mvp)) {
+                    continue;
+                }
+                
+                const Node &m(nodes[c]);
+                const GLfloat center[4] = { m.min[0] + m.size * 0.5f, m.min[1] + m.size * 0.5f, m.min[2] + m.size * 0.5f, 1.0f };
+                GLfloat v[4];
+                modelview.apply(center, v);
+                
+                // 中心までの距離から立方体の半径を引いた距離で点の間隔を見積もる
+                const GLfloat distance(std::max(std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]) - m.size * unit * 0.866f, 1.0e-3f));
+                const GLfloat spacing(m.size * unit / std::sqrt(static_cast<GLfloat>(std::max(m.count, 1u))));
+                
+                heap.emplace_back(spacing * pixels / distance, c);
+                std::push_heap(heap.begin(), heap.end());
+            }
+        }
+        
+        // まだ読み込みが始まっていない前のフレームの頼みは取り消し, 今の節点を大事な順に頼み直す
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = requestHead; i < requests.size(); ++i) {
+                resident[requests[i]].state = EMPTY;
+            }
+            requests.clear();
+            requestHead = 0;
+            
+            for (int n : selected) {
+                Resident &r(resident[n]);
+                r.used = frame;
+                if (r.state == RESIDENT) {
+                    unlink(n);
+                    pushNewest(n);
+                } else if (r.state == EMPTY) {
+                    r.state = REQUESTED;
+                    requests.push_back(n);
+                }
+            }
+        }
+        wake.notify_one();
+        
+        // GPU に置いた点が上限を超えたら, このフレームに使っていない節点を使わなくなった順に捨てる
+        while (residentPoints > budget && oldest >= 0 && resident[oldest].used != frame) {
+            const int n(oldest);
+            Resident &r(resident[n]);
+            unlink(n);
+            pool.releaseBuffer(r.buffer);
+            r.buffer.name = 0;
+            r.state = EMPTY;
+            residentPoints -= nodes[n].count;
+        }
+    }
+    
+    // 選んだ節点のうち GPU にあるものを描く
+    void draw(const Matrix &projection, const Matrix &modelview, GLfloat height){
+        if (nodes.empty()) {
+            return;
+        }
+        
+        const GLfloat *const mv(modelview.data());
+        const GLfloat unit(std::sqrt(mv[0] * mv[0] + mv[1] * mv[1] + mv[2] * mv[2]));
+        
+        program.use();
+        program.set(projectionLoc, projection);
+        program.set(modelviewLoc, modelview);
+        program.set(scaleLoc, projection.data()[5] * height * 0.5f);
+        
+        ResourcePool &pool(ResourcePool::instance());
+        
+        glEnable(GL_PROGRAM_POINT_SIZE);
+        glBindVertexArray(vao);
+        glEnableVertexAttribArray(0);
+        if (colorAttrib >= 0) glEnableVertexAttribArray(colorAttrib);
+        
+        for (int n : selected) {
+            const Resident &r(resident[n]);
+            if (r.state != RESIDENT) {
+                continue;
+            }
+            
+            const Node &node(nodes[n]);
+            program.set(spacingLoc, node.size * unit / std::sqrt(static_cast<GLfloat>(std::max(node.count, 1u))));
+            
+            pool.touch(r.buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, r.buffer.name);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Point), static_cast<Point *>(0)->position);
+            if (colorAttrib >= 0) {
+                glVertexAttribPointer(colorAttrib, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Point), static_cast<Point *>(0)->color);
+            }
+            glDrawArrays(GL_POINTS, 0, node.count);
+        }
+        
+        glDisable(GL_PROGRAM_POINT_SIZE);
+    }
+};
@@ -0,0 +1,293 @@
+#pragma once
+#include <array>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include "../log.hpp"
+#include "Matrix.h"
+
+// ユニフォーム変数の C++ での型と GLSL の型の対応
+template <typename T>
+struct UniformType;
+
+template <>
+struct UniformType<GLfloat>{
+    static constexpr GLenum type = GL_FLOAT;
+};
+
+template <>
+struct UniformType<GLint>{
+    static constexpr GLenum type = GL_INT;
+};
+
+template <>
+struct UniformType<std::array<GLfloat, 2>>{
+    static constexpr GLenum type = GL_FLOAT_VEC2;
+};
+
+template <>
+struct UniformType<std::array<GLfloat, 3>>{
+    static constexpr GLenum type = GL_FLOAT_VEC3;
+};
+
+template <>
+struct UniformType<std::array<GLfloat, 4>>{
+    static constexpr GLenum type = GL_FLOAT_VEC4;
+};
+
+template <>
+struct UniformType<std::array<GLfloat, 9>>{
+    static constexpr GLenum type = GL_FLOAT_MAT3;
+};
+
+template <>
+struct UniformType<Matrix>{
+    static constexpr GLenum type = GL_FLOAT_MAT4;
+};
+
+// リンクしたプログラムオブジェクトのユニフォーム変数とユニフォームブロックを一度だけ調べておき,
+// 値の写しを持っておいて変わった値だけをドライバに送る
+class Program{
+public:
+    // ユニフォーム変数の表の中の番号 (見つからなければ -1)
+    template <typename T>
+    class Variable{
+        friend class Program;
+        int index;
+        
+        explicit Variable(int index)
+        : index(index){
+            
+        }
+        
+    public:
+        bool valid() const{
+            return index >= 0;
+        }
+    };
+    
+    struct Counters{
+        unsigned long uploaded;  // ドライバに送った要素の数
+        unsigned long skipped;   // 値が同じだったので送らなかった要素の数
+    };
+    
+private:
+    struct Entry{
+        std::string name;
+        GLenum type;
+        
+        // 配列の要素の数
+        GLint count;
+        
+        // 要素ごとの場所は locations[first + i]
+        size_t first;
+        
+        // 値の写しは shadow[offset + i * bytes]
+        size_t offset;
+        size_t bytes;
+    };
+    
+    struct Block{
+        std::string name;
+        GLuint index;
+        GLint size;
+    };
+    
+    const GLuint program;
+    
+    std::vector<Entry> entries;
+    std::vector<GLint> locations;
+    std::vector<unsigned char> shadow;
+    std::vector<Block> blocks;
+    
+    Counters counters;
+    
+    // 今使っているプログラムオブジェクト
+    static GLuint &current(){
+        static GLuint program(0);
+        return program;
+    }
+    
+    static size_t bytesOf(GLenum type){
+        switch (type) {
+            case GL_FLOAT_VEC2: return 8;
+            case GL_FLOAT_VEC3: return 12;
+            case GL_FLOAT_VEC4: return 16;
+            case GL_FLOAT_MAT3: return 36;
+            case GL_FLOAT_MAT4: return 64;
+            default: return 4;
+        }
+    }
+    
+    static void upload(GLenum type, GLint location, const void *value){
+        const GLfloat *const f(static_cast<const GLfloat *>(value));
+        
+        switch (type) {
+            case GL_FLOAT: glUniform1fv(location, 1, f); break;
+            case GL_FLOAT_VEC2: glUniform2fv(location, 1, f); break;
+            case GL_FLOAT_VEC3: glUniform3fv(location, 1, f); break;
+            case GL_FLOAT_VEC4: glUniform4fv(location, 1, f); break;
+            case GL_FLOAT_MAT3: glUniformMatrix3fv(location, 1, GL_FALSE, f); break;
+            case GL_FLOAT_MAT4: glUniformMatrix4fv(location, 1, GL_FALSE, f); break;
+            default: glUniform1iv(location, 1, static_cast<const GLint *>(value)); break;
+        }
+    }
+    
+    void reflect(){
+        if (program == 0) {
+            return;
+        }
+        
+        GLint count, length;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &length);
+        std::vector<GLchar> name(length + 1);
+        
+        for (GLint i = 0; i < count; ++i) {
+            const GLuint u(i);
+            GLint block;
+            glGetActiveUniformsiv(program, 1, &u, GL_UNIFORM_BLOCK_INDEX, &block);
+            if (block >= 0) {
+                continue;
+            }
+            
+            Entry e;
+            glGetActiveUniform(program, u, length + 1, NULL, &e.count, &e.type, name.data());
+            
+            // 配列は "名前[0]" と報告されるので添字を取り除く
+            e.name = name.data();
+            const std::string::size_type bracket(e.name.find('['));
+            if (bracket != std::string::npos) {
+                e.name.erase(bracket);
+            }
+            
+            // 配列の要素の場所が連続しているとは限らないので要素ごとに調べる
+            e.first = locations.size();
+            for (GLint k = 0; k < e.count; ++k) {
+                const std::string element(e.count > 1 ? e.name + "[" + std::to_string(k) + "]" : e.name);
+                locations.push_back(glGetUniformLocation(program, element.c_str()));
+            }
+            
+            e.bytes = bytesOf(e.type);
+            e.offset = shadow.size();
+            shadow.resize(shadow.size() + e.bytes * e.count);
+            
+            entries.push_back(e);
+        }
+        
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &length);
+        name.resize(length + 1);
+        
+        for (GLint i = 0; i < count; ++i) {
+            Block b;
+            b.index = i;
+            glGetActiveUniformBlockName(program, b.index, length + 1, NULL, name.data());
+            glGetActiveUniformBlockiv(program, b.index, GL_UNIFORM_BLOCK_DATA_SIZE, &b.size);
+            b.name = name.data();
+            
+            blocks.push_back(b);
+        }
+    }
+    
+public:
+    // program はリンク済みのプログラムオブジェクト (このオブジェクトが削除する)
+    explicit Program(GLuint program)
+    : program(program), counters(){
+        reflect();
+    }
+    
+    virtual ~Program(){
+        if (current() == program) {
+            current() = 0;
+        }
+        glDeleteProgram(program);
+    }
+    
+private:
+    Program(const Program &p);
+    Program &operator=(const Program &p);
+    
+public:
+    GLuint get() const{
+        return program;
+    }
+    
+    // 型が T のユニフォーム変数 name を探す
+    template <typename T>
+    Variable<T> uniform(const char *name) const{
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (entries[i].name == name) {
+                if (entries[i].type != UniformType<T>::type) {
+                    logMessage(LOG_ERROR, LOG_SHADER, "type mismatch for uniform: {}", name);
+                    break;
+                }
+                return Variable<T>(static_cast<int>(i));
+            }
+        }
+        
+        return Variable<T>(-1);
+    }
+    
+    // ユニフォームブロック name を結合ポイント binding に結びつける
+    // T の大きさがブロックより小さければ失敗する
+    template <typename T>
+    bool bind(const char *name, GLuint binding) const{
+        for (const Block &b : blocks) {
+            if (b.name == name) {
+                if (static_cast<size_t>(b.size) > sizeof(T)) {
+                    logMessage(LOG_ERROR, LOG_SHADER, "uniform block is larger than its C++ type: {}", name);
+                    return false;
+                }
+                
+                glUniformBlockBinding(program, b.index, binding);
+                return true;
+            }
+        }
+        
+        return false;
+    }
+    
+    // このプログラムオブジェクトを使う. すでに使っていれば何もしない
+    void use() const{
+        if (current() != program) {
+            glUseProgram(program);
+            current() = program;
+        }
+    }
+    
+    // 配列 v の要素 first から count 個の値を設定する. use() しておくこと
+    template <typename T>
+    void set(Variable<T> v, const T *value, int count = 1, int first = 0){
+        if (v.index < 0) {
+            return;
+        }
+        
+        const Entry &e(entries[v.index]);
+        const int last(first + count < e.count ? first + count : e.count);
+        
+        for (int i = first; i < last; ++i) {
+            unsigned char *const copy(&shadow[e.offset + i * e.bytes]);
+            const void *const data(value + (i - first));
+            
+            if (std::memcmp(copy, data, e.bytes) == 0) {
+                ++counters.skipped;
+                continue;
+            }
+            
+            std::memcpy(copy, data, e.bytes);
+            upload(e.type, locations[e.first + i], data);
+            ++counters.uploaded;
+        }
+    }
+    
+    template <typename T>
+    void set(Variable<T> v, const T &value){
+        set(v, &value, 1, 0);
+    }
+    
+    const Counters &getCounters() const{
+        return counters;
+    }
+};
@@ -0,0 +1,61 @@
+#pragma once
+#include <cmath>
+#include <GL/glew.h>
+#include "Matrix.h"
+
+// 回転を表す四元数 (x, y, z がベクトル部, w がスカラー部)
+struct Quaternion{
+    GLfloat x, y, z, w;
+    
+    // 軸 (ax, ay, az) 周りに a 回転する四元数を作る
+    static Quaternion rotate(GLfloat a, GLfloat ax, GLfloat ay, GLfloat az){
+        const GLfloat d(std::sqrt(ax*ax+ay*ay+az*az));
+        if (d == 0.0f) {
+            return Quaternion{ 0.0f, 0.0f, 0.0f, 1.0f };
+        }
+        
+        const GLfloat s(std::sin(a * 0.5f) / d);
+        return Quaternion{ ax * s, ay * s, az * s, std::cos(a * 0.5f) };
+    }
+    
+    // q0 から q1 へ t の割合だけ球面線形補間する
+    static Quaternion slerp(const Quaternion &q0, const Quaternion &q1, GLfloat t){
+        GLfloat c(q0.x*q1.x + q0.y*q1.y + q0.z*q1.z + q0.w*q1.w);
+        
+        // 遠回りしないように向きをそろえる
+        const GLfloat sign(c < 0.0f ? -1.0f : 1.0f);
+        c *= sign;
+        
+        GLfloat k0(1.0f - t), k1(t * sign);
+        
+        // 角度が小さいときは線形補間で十分
+        if (c < 0.9995f) {
+            const GLfloat a(std::acos(c));
+            const GLfloat s(1.0f / std::sin(a));
+            k0 = std::sin(k0 * a) * s;
+            k1 = std::sin(t * a) * s * sign;
+        }
+        
+        Quaternion q{ k0*q0.x + k1*q1.x, k0*q0.y + k1*q1.y, k0*q0.z + k1*q1.z, k0*q0.w + k1*q1.w };
+        const GLfloat l(1.0f / std::sqrt(q.x*q.x + q.y*q.y + q.z*q.z + q.w*q.w));
+        q.x *= l; q.y *= l; q.z *= l; q.w *= l;
+        
+        return q;
+    }
+    
+    // 回転 q, 平行移動 (tx, ty, tz) の変換行列を作る
+    static Matrix transform(const Quaternion &q, GLfloat tx, GLfloat ty, GLfloat tz){
+        const GLfloat xx(q.x*q.x), yy(q.y*q.y), zz(q.z*q.z);
+        const GLfloat xy(q.x*q.y), yz(q.y*q.z), zx(q.z*q.x);
+        const GLfloat wx(q.w*q.x), wy(q.w*q.y), wz(q.w*q.z);
+        
+        const GLfloat m[] = {
+            1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (zx - wy), 0.0f,
+            2.0f * (xy - wz), 1.0f - 2.0f * (zz + xx), 2.0f * (yz + wx), 0.0f,
+            2.0f * (zx + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f,
+            tx, ty, tz, 1.0f
+        };
+        
+        return Matrix(m);
+    }
+};
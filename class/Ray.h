@@ -0,0 +1,65 @@
+#pragma once
+#include <limits>
+#include <GL/glew.h>
+#include "Matrix.h"
+
+// 光線. direction は正規化しないので t は direction の長さを単位にした距離になる
+struct Ray{
+    GLfloat origin[3];
+    GLfloat direction[3];
+    
+    // 正規化デバイス座標 (x, y) の点を通る光線を, projection * view を逆にたどってワールド座標で求める
+    static Ray fromCursor(const Matrix &projection, const Matrix &view, GLfloat x, GLfloat y){
+        const Matrix inverse(Matrix(projection * view).inverse());
+        
+        static constexpr GLfloat z[2] = { -1.0f, 1.0f };
+        GLfloat p[2][4];
+        for (int i = 0; i < 2; ++i) {
+            const GLfloat v[4] = { x, y, z[i], 1.0f };
+            inverse.apply(v, p[i]);
+        }
+        
+        Ray ray;
+        for (int k = 0; k < 3; ++k) {
+            ray.origin[k] = p[0][k] / p[0][3];
+            ray.direction[k] = p[1][k] / p[1][3] - ray.origin[k];
+        }
+        return ray;
+    }
+    
+    // m で変換した光線. t はそのまま使える
+    Ray transform(const Matrix &m) const{
+        const GLfloat o[4] = { origin[0], origin[1], origin[2], 1.0f };
+        const GLfloat d[4] = { direction[0], direction[1], direction[2], 0.0f };
+        GLfloat to[4], td[4];
+        m.apply(o, to);
+        m.apply(d, td);
+        
+        const Ray ray = { { to[0], to[1], to[2] }, { td[0], td[1], td[2] } };
+        return ray;
+    }
+    
+    // t の位置
+    void at(GLfloat t, GLfloat *p) const{
+        for (int k = 0; k < 3; ++k) {
+            p[k] = origin[k] + direction[k] * t;
+        }
+    }
+};
+
+// 光線が最初に当たった三角形
+struct Hit{
+    GLfloat t;
+    
+    // 三角形の番号 (指標の 3 個ずつの番号) と, 当たった点の重心座標
+    GLint triangle;
+    GLfloat u, v;
+    
+    // Picker に加えた順の番号
+    GLint instance;
+    
+    static Hit none(){
+        const Hit hit = { std::numeric_limits<GLfloat>::infinity(), -1, 0.0f, 0.0f, -1 };
+        return hit;
+    }
+};
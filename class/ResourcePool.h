@@ -0,0 +1,522 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include <GL/glew.h>
+#include "../log.hpp"
+
+// 頂点配列オブジェクトとバッファオブジェクトを使い回す
+// 手放されたものはそのフレームの描画が GPU で終わったことをフェンスで確かめてから再利用する
+// バッファの容量と最後に使ったフレームを用途ごとに数え, 予算を超えたら長く使っていない Evictable を追い出す
+// 描画スレッドの GL コンテキストからだけ使う
+class ResourcePool{
+public:
+    // バッファの用途. 作るときの target で決める
+    enum Category{ VERTEX, INDEX, UNIFORM, OTHER, CATEGORY_COUNT };
+    
+    struct Buffer{
+        GLuint name;
+        
+        // 確保してある容量 (サイズクラスの大きさ)
+        GLsizeiptr capacity;
+    };
+    
+    struct Counters{
+        unsigned long generated;  // glGen* で新しく作った数
+        unsigned long recycled;   // 使い回した数
+        unsigned long released;   // 手放された数
+        unsigned long retired;    // フェンスを通過して再利用できるようになった数
+        unsigned long deleted;    // 再利用されずに削除した数
+        size_t liveBytes;         // 使用中のバッファの容量の合計
+        size_t freeBytes;         // 再利用を待っているバッファの容量の合計
+        unsigned long evicted;    // 予算を超えて追い出した Evictable の数
+        unsigned long restored;   // 追い出したあとに使われて作り直した数
+        size_t evictedBytes;      // 追い出している Evictable が GPU で使っていたバイト数
+    };
+    
+    struct Usage{
+        unsigned long buffers;    // 使用中のバッファの数
+        size_t bytes;             // その容量の合計
+        size_t peak;              // bytes の最大
+    };
+    
+    // 予算を超えたときに GPU から追い出せるもの. 作り直すための CPU の写しは自分で持っておく
+    // 描画の前に ResourcePool::use() を呼び, 追い出されていれば restore() で作り直してもらう
+    // 追い出しと作り直しは描画の結果を変えないので const で行う
+    class Evictable{
+        friend class ResourcePool;
+        
+        mutable unsigned long lastUsed;
+        mutable bool resident;
+        
+        // 追い出したときの residentBytes()
+        size_t evictedBytes;
+        
+        // ResourcePool::evictables の中の位置
+        size_t index;
+        
+    protected:
+        Evictable() : lastUsed(ResourcePool::instance().frame), resident(true), evictedBytes(0){
+            ResourcePool &pool(ResourcePool::instance());
+            index = pool.evictables.size();
+            pool.evictables.push_back(this);
+        }
+        
+        virtual ~Evictable(){
+            ResourcePool &pool(ResourcePool::instance());
+            if (!resident) {
+                pool.counters.evictedBytes -= evictedBytes;
+            }
+            
+            std::vector<Evictable *> &list(pool.evictables);
+            list[index] = list.back();
+            list[index]->index = index;
+            list.pop_back();
+        }
+        
+        // GPU 上の資源を手放す. GPU から読み戻さない
+        virtual void evict() const = 0;
+        
+        // 写しから GPU 上の資源を作り直す
+        virtual void restore() const = 0;
+        
+        // 追い出すと空くバイト数
+        virtual size_t residentBytes() const = 0;
+        
+    private:
+        Evictable(const Evictable &e);
+        Evictable &operator=(const Evictable &e);
+    };
+    
+private:
+    // サイズクラスは 256 バイトから 2 倍ずつ
+    static constexpr int classCount = 32;
+    static constexpr GLsizeiptr minimumCapacity = 256;
+    
+    // GL_STREAM_DRAW から GL_DYNAMIC_COPY までの usage の数
+    static constexpr int usageCount = 9;
+    
+    // この数のフレームの間再利用されなかったバッファは削除する
+    static constexpr unsigned long idleFrames = 600;
+    
+    // 再利用を待っているバッファと, 待ち始めたフレーム
+    struct Free{
+        GLuint name;
+        unsigned long since;
+    };
+    
+    // 一つのフレームで手放されたもの
+    struct Retired{
+        GLsync fence;
+        std::vector<GLuint> arrays;
+        std::vector<Buffer> buffers;
+        
+        // 再利用せずに削除するもの
+        std::vector<GLuint> discarded;
+    };
+    
+    // 使用中のバッファの用途と容量と最後に使ったフレーム, 作ったときの usage. バッファの名前で引く
+    struct Tracked{
+        Category category;
+        GLsizeiptr capacity;
+        unsigned long lastUsed;
+        GLenum usage;
+    };
+    
+    std::vector<GLuint> freeArrays;
+    
+    // usage とサイズクラスごとの置き場. usage の違うバッファはドライバが置く場所が違うので混ぜない
+    std::vector<Free> freeBuffers[usageCount][classCount];
+    
+    // 今のフレームで手放されたもの
+    Retired pending;
+    
+    // GPU の処理が終わるのを待っているもの. retiredHead から retiredCount 個を古い順に使う輪
+    // 使い終わった要素は配列の容量ごと次のフレームの pending と入れ替えて使い回す
+    std::vector<Retired> retired;
+    size_t retiredHead;
+    size_t retiredCount;
+    
+    Counters counters;
+    
+    GLint maxAttribs;
+    
+    std::vector<Tracked> tracked;
+    Usage usage[CATEGORY_COUNT];
+    
+    // endFrame() を呼んだ回数
+    unsigned long frame;
+    
+    // GPU に置くバッファの容量の上限 (0 なら制限しない)
+    size_t budget;
+    
+    // 前のフレームから予算を超えたままか. 超えたフレームにだけ再利用を待っているバッファを削り, 警告する
+    bool overBudget;
+    
+    std::vector<Evictable *> evictables;
+    std::vector<Evictable *> candidates;
+    
+    ResourcePool()
+    : pending(), retired(4), retiredHead(0), retiredCount(0)
+    , counters(), maxAttribs(0), usage(), frame(0), budget(0), overBudget(false){
+        
+    }
+    
+    ResourcePool(const ResourcePool &p);
+    ResourcePool &operator=(const ResourcePool &p);
+    
+    static int sizeClass(GLsizeiptr size){
+        int c(0);
+        for (GLsizeiptr capacity(minimumCapacity); capacity < size && c < classCount - 1; capacity <<= 1) {
+            ++c;
+        }
+        
+        return c;
+    }
+    
+    static int usageIndex(GLenum usage){
+        const int i(static_cast<int>(usage) - GL_STREAM_DRAW);
+        return i >= 0 && i < 12 && i % 4 != 3 ? i / 4 * 3 + i % 4 : 0;
+    }
+    
+    static Category categoryOf(GLenum target){
+        switch (target) {
+            case GL_ARRAY_BUFFER: return VERTEX;
+            case GL_ELEMENT_ARRAY_BUFFER: return INDEX;
+            case GL_UNIFORM_BUFFER: return UNIFORM;
+            default: return OTHER;
+        }
+    }
+    
+    void track(const Buffer &buffer, GLenum target, GLenum hint){
+        if (buffer.name >= tracked.size()) {
+            tracked.resize(buffer.name + 1);
+        }
+        const Tracked t = { categoryOf(target), buffer.capacity, frame, hint };
+        tracked[buffer.name] = t;
+        
+        Usage &u(usage[t.category]);
+        ++u.buffers;
+        u.bytes += buffer.capacity;
+        u.peak = std::max(u.peak, u.bytes);
+        counters.liveBytes += buffer.capacity;
+    }
+    
+    void untrack(const Buffer &buffer){
+        Usage &u(usage[tracked[buffer.name].category]);
+        --u.buffers;
+        u.bytes -= buffer.capacity;
+        counters.liveBytes -= buffer.capacity;
+        ++counters.released;
+    }
+    
+    // 予算を超えていれば, 超えたフレームに一度だけ超えた分の再利用を待っているバッファを削除し,
+    // それでも超えていれば長く使っていない Evictable を追い出す
+    // このフレームと前のフレームで使ったものは GPU がまだ読んでいるかもしれないので追い出さない
+    void enforceBudget(){
+        const size_t total(counters.liveBytes + counters.freeBytes);
+        if (budget == 0 || total <= budget) {
+            overBudget = false;
+            return;
+        }
+        
+        if (!overBudget) {
+            deleteFreeBytes(total - budget);
+        }
+        
+        if (counters.liveBytes > budget) {
+            candidates.clear();
+            for (Evictable *e : evictables) {
+                if (e->resident && e->lastUsed + 2 <= frame) {
+                    candidates.push_back(e);
+                }
+            }
+            std::sort(candidates.begin(), candidates.end(), [](const Evictable *a, const Evictable *b){
+                return a->lastUsed < b->lastUsed;
+            });
+            
+            for (Evictable *e : candidates) {
+                if (counters.liveBytes <= budget) {
+                    break;
+                }
+                e->evictedBytes = e->residentBytes();
+                e->evict();
+                e->resident = false;
+                ++counters.evicted;
+                counters.evictedBytes += e->evictedBytes;
+            }
+        }
+        
+        // 追い出せるものがなくなっても超えていれば一度だけ知らせる
+        if (counters.liveBytes > budget && !overBudget) {
+            logMessage(LOG_WARNING, LOG_RESOURCE, "GPU buffers use {} bytes, over the budget of {} bytes", counters.liveBytes, budget);
+        }
+        overBudget = counters.liveBytes > budget;
+    }
+    
+    // before より前のフレームから再利用を待っているバッファを削除する
+    // 置き場は待ち始めた順に並んでいるので先頭から消す
+    void deleteFreeBuffers(unsigned long before){
+        for (auto &lists : freeBuffers) {
+            for (int c = 0; c < classCount; ++c) {
+                std::vector<Free> &list(lists[c]);
+                
+                size_t n(0);
+                while (n < list.size() && list[n].since < before) {
+                    glDeleteBuffers(1, &list[n].name);
+                    ++n;
+                }
+                
+                if (n > 0) {
+                    list.erase(list.begin(), list.begin() + n);
+                    counters.deleted += n;
+                    counters.freeBytes -= n * (minimumCapacity << c);
+                }
+            }
+        }
+    }
+    
+    // 再利用を待っているバッファを, 待ち始めたのが古いものから bytes 以上の容量になるまで削除する
+    void deleteFreeBytes(size_t bytes){
+        size_t deleted(0);
+        
+        while (deleted < bytes) {
+            std::vector<Free> *oldest(NULL);
+            int oldestClass(0);
+            for (auto &lists : freeBuffers) {
+                for (int c = 0; c < classCount; ++c) {
+                    if (!lists[c].empty() && (oldest == NULL || lists[c].front().since < oldest->front().since)) {
+                        oldest = &lists[c];
+                        oldestClass = c;
+                    }
+                }
+            }
+            if (oldest == NULL) {
+                break;
+            }
+            
+            glDeleteBuffers(1, &oldest->front().name);
+            oldest->erase(oldest->begin());
+            
+            const size_t capacity(minimumCapacity << oldestClass);
+            ++counters.deleted;
+            counters.freeBytes -= capacity;
+            deleted += capacity;
+        }
+    }
+    
+    // GL コンテキストが破棄されたあとに呼ばれることがあるのでデストラクタでは GL を呼ばない
+public:
+    static ResourcePool &instance(){
+        static ResourcePool pool;
+        return pool;
+    }
+    
+    // 頂点配列オブジェクトを作って結合する
+    GLuint createVertexArray(){
+        GLuint vao;
+        
+        if (freeArrays.empty()) {
+            glGenVertexArrays(1, &vao);
+            glBindVertexArray(vao);
+            ++counters.generated;
+        } else {
+            vao = freeArrays.back();
+            freeArrays.pop_back();
+            glBindVertexArray(vao);
+            
+            // 前に使っていたときの頂点属性を無効にする
+            if (maxAttribs == 0) {
+                glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &maxAttribs);
+            }
+            for (GLint i = 0; i < maxAttribs; ++i) {
+                glDisableVertexAttribArray(i);
+            }
+            ++counters.recycled;
+        }
+        
+        return vao;
+    }
+    
+    void releaseVertexArray(GLuint vao){
+        if (vao == 0) {
+            return;
+        }
+        
+        pending.arrays.push_back(vao);
+        ++counters.released;
+    }
+    
+    // size バイト以上の容量のバッファオブジェクトを target に結合し, data があれば先頭に転送する
+    Buffer createBuffer(GLenum target, GLsizeiptr size, const void *data, GLenum usage = GL_STATIC_DRAW){
+        if (size <= 0) {
+            const Buffer empty = { 0, 0 };
+            return empty;
+        }
+        
+        const int c(sizeClass(size));
+        Buffer buffer = { 0, minimumCapacity << c };
+        if (buffer.capacity < size) {
+            buffer.capacity = size;
+        }
+        
+        std::vector<Free> &list(freeBuffers[usageIndex(usage)][c]);
+        if (!list.empty() && (minimumCapacity << c) >= size) {
+            buffer.name = list.back().name;
+            list.pop_back();
+            glBindBuffer(target, buffer.name);
+            counters.freeBytes -= buffer.capacity;
+            ++counters.recycled;
+        } else {
+            glGenBuffers(1, &buffer.name);
+            glBindBuffer(target, buffer.name);
+            glBufferData(target, buffer.capacity, NULL, usage);
+            ++counters.generated;
+        }
+        
+        if (data != NULL) {
+            glBufferSubData(target, 0, size, data);
+        }
+        
+        track(buffer, target, usage);
+        return buffer;
+    }
+    
+    void releaseBuffer(const Buffer &buffer){
+        if (buffer.name == 0) {
+            return;
+        }
+        
+        pending.buffers.push_back(buffer);
+        untrack(buffer);
+    }
+    
+    // 再利用せずに, GPU が使い終わったら削除する (メモリを本当に空けたいとき)
+    void discardBuffer(const Buffer &buffer){
+        if (buffer.name == 0) {
+            return;
+        }
+        
+        pending.discarded.push_back(buffer.name);
+        untrack(buffer);
+    }
+    
+    // バッファを使ったことを記録する
+    void touch(const Buffer &buffer){
+        if (buffer.name != 0) {
+            tracked[buffer.name].lastUsed = frame;
+        }
+    }
+    
+    unsigned long getLastUsed(const Buffer &buffer) const{
+        return tracked[buffer.name].lastUsed;
+    }
+    
+    // 描画に使う前に呼ぶ. 追い出されていれば作り直す
+    void use(const Evictable &e){
+        e.lastUsed = frame;
+        if (!e.resident) {
+            e.restore();
+            e.resident = true;
+            ++counters.restored;
+            counters.evictedBytes -= e.evictedBytes;
+        }
+    }
+    
+    // フレームの終わりに呼ぶ. 今のフレームで手放したものにフェンスを置き,
+    // GPU が処理し終えたフレームで手放されたものを再利用できるようにする
+    void endFrame(){
+        if (!pending.arrays.empty() || !pending.buffers.empty() || !pending.discarded.empty()) {
+            pending.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            
+            // 輪が一杯なら古い順に並べ直して広げる
+            if (retiredCount == retired.size()) {
+                std::rotate(retired.begin(), retired.begin() + retiredHead, retired.end());
+                retired.resize(2 * retired.size());
+                retiredHead = 0;
+            }
+            std::swap(retired[(retiredHead + retiredCount) % retired.size()], pending);
+            ++retiredCount;
+        }
+        
+        while (retiredCount > 0) {
+            Retired &r(retired[retiredHead]);
+            
+            const GLenum status(glClientWaitSync(r.fence, 0, 0));
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+                break;
+            }
+            glDeleteSync(r.fence);
+            
+            for (GLuint vao : r.arrays) {
+                freeArrays.push_back(vao);
+            }
+            for (const Buffer &b : r.buffers) {
+                const Free f = { b.name, frame };
+                freeBuffers[usageIndex(tracked[b.name].usage)][sizeClass(b.capacity)].push_back(f);
+                counters.freeBytes += b.capacity;
+            }
+            counters.retired += r.arrays.size() + r.buffers.size();
+            
+            if (!r.discarded.empty()) {
+                glDeleteBuffers(static_cast<GLsizei>(r.discarded.size()), r.discarded.data());
+                counters.deleted += r.discarded.size();
+            }
+            
+            r.arrays.clear();
+            r.buffers.clear();
+            r.discarded.clear();
+            retiredHead = (retiredHead + 1) % retired.size();
+            --retiredCount;
+        }
+        
+        ++frame;
+        
+        // 長く再利用されないバッファはときどきまとめて削除する
+        if (frame % 64 == 0) {
+            deleteFreeBuffers(frame > idleFrames ? frame - idleFrames : 0);
+        }
+        
+        enforceBudget();
+    }
+    
+    // 再利用を待っているものを削除する
+    void trim(){
+        counters.deleted += freeArrays.size();
+        if (!freeArrays.empty()) {
+            glDeleteVertexArrays(static_cast<GLsizei>(freeArrays.size()), freeArrays.data());
+            freeArrays.clear();
+        }
+        
+        deleteFreeBuffers(frame + 1);
+    }
+    
+    const Counters &getCounters() const{
+        return counters;
+    }
+    
+    const Usage &getUsage(Category category) const{
+        return usage[category];
+    }
+    
+    // bytes を超えたら endFrame() で追い出す. 0 なら制限しない
+    void setBudget(size_t bytes){
+        budget = bytes;
+    }
+    
+    size_t getBudget() const{
+        return budget;
+    }
+    
+    // 用途ごとの使用量をログに出す
+    void logReport() const{
+        static const char *const names[CATEGORY_COUNT] = { "vertex", "index", "uniform", "other" };
+        
+        for (int c = 0; c < CATEGORY_COUNT; ++c) {
+            const Usage &u(usage[c]);
+            logMessage(LOG_INFO, LOG_RESOURCE, "{}: {} buffers, {} bytes (peak {})", names[c], u.buffers, u.bytes, u.peak);
+        }
+        logMessage(LOG_INFO, LOG_RESOURCE, "total {} bytes live, {} bytes free, budget {}; evicted {} ({} bytes), restored {}",
+                   counters.liveBytes, counters.freeBytes, budget, counters.evicted, counters.evictedBytes, counters.restored);
+    }
+};
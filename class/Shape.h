@@ -1,22 +1,31 @@
 #pragma once
-#include <memory>
-
+#include "Handle.h"
 #include "Object.h"
 
 class Shape {
-    std::shared_ptr<const Object> object;
+    Handle<const Object> object;
 
 protected:
     const GLsizei vertexcount;
     
 public:
     Shape(GLint size, GLsizei vertexcount, const Object::Vertex *vertex, GLsizei indexcount = 0, const GLuint *index = NULL)
-    : object(new Object(size, vertexcount, vertex, indexcount, index))
+    : object(Handle<const Object>::make(size, vertexcount, vertex, indexcount, index))
     , vertexcount(vertexcount){
         
+    }
+    
+    Shape(GLint size, const EncodedMesh &mesh)
+    : object(Handle<const Object>::make(size, mesh))
+    , vertexcount(mesh.vertexcount){
+        
     }
 
+    // 頂点を展開できなかった形は描かない
     void draw() const{
+        if (!object->valid()) {
+            return;
+        }
         object->bind();
         execute();
     }
@@ -11,6 +11,12 @@ public:
     : Shape(size, vertexcount, vertex, indexcount, index)
     , indexcount(indexcount){
         
+    }
+    
+    ShapeIndex(GLint size, const EncodedMesh &mesh)
+    : Shape(size, mesh)
+    , indexcount(mesh.indexcount){
+        
     }
 
     virtual void execute() const{
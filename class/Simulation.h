@@ -0,0 +1,143 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include "TripleBuffer.h"
+#include "Window.h"
+
+// 入力の処理とアニメーションを描画とは別のスレッドで一定の周期で進める
+class Simulation{
+public:
+    // 描画スレッドに渡すシミュレーションの状態
+    struct State{
+        GLfloat location[2];
+        GLfloat scale;
+        GLfloat angle;
+        
+        // この状態のシミュレーション時刻
+        double time;
+        
+        // この状態に反映した入力をサンプリングした時刻
+        double inputTime;
+    };
+    
+private:
+    // 補間できるように直前の状態と組にして公開する
+    struct Frame{
+        State previous;
+        State current;
+    };
+    
+    TripleBuffer<Window::Input> &input;
+    
+    // 1 ステップの時間 [秒]
+    const double step;
+    
+    TripleBuffer<Frame> frames;
+    
+    std::atomic<bool> running;
+    
+    std::thread thread;
+    
+public:
+    Simulation(Window &window, double rate = 120.0)
+    : input(window.getInput()), step(1.0 / rate), running(true){
+        const State initial = { { 0.0f, 0.0f }, 100.0f, 0.0f, glfwGetTime(), 0.0 };
+        Frame &frame(frames.write());
+        frame.previous = frame.current = initial;
+        frames.publish();
+        
+        thread = std::thread(&Simulation::run, this, initial);
+    }
+    
+    virtual ~Simulation(){
+        running.store(false, std::memory_order_relaxed);
+        thread.join();
+    }
+    
+private:
+    Simulation(const Simulation &s);
+    Simulation &operator=(const Simulation &s);
+    
+    // 読み出し側のバッファには触れないように, 最初の状態は引数で受け取る
+    void run(State state){
+        // 前のステップまでに反映したホイールの累積量
+        GLfloat wheel(0.0f);
+        
+        double next(state.time);
+        
+        while (running.load(std::memory_order_relaxed)) {
+            next += step;
+            
+            const double wait(next - glfwGetTime());
+            if (wait > 0.0) {
+                std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+            } else if (wait < -0.25) {
+                // 大きく遅れたら追いつこうとせずに時刻を合わせる
+                next = glfwGetTime();
+            }
+            
+            const State previous(state);
+            
+            input.update();
+            const Window::Input &in(input.read());
+            
+            // 1 秒あたりの移動量はウィンドウの幅と高さの 120 分の 1 の 2 倍
+            if (in.size[0] > 0.0f && in.size[1] > 0.0f) {
+                const GLfloat dx(120.0f * static_cast<GLfloat>(step) / in.size[0]);
+                const GLfloat dy(120.0f * static_cast<GLfloat>(step) / in.size[1]);
+                
+                if (in.left)
+                    state.location[0] -= dx;
+                else if (in.right)
+                    state.location[0] += dx;
+                if (in.down)
+                    state.location[1] -= dy;
+                else if (in.up)
+                    state.location[1] += dy;
+                
+                if (in.button) {
+                    state.location[0] = in.cursor[0] * 2.0f / in.size[0] - 1.0f;
+                    state.location[1] = 1.0f - in.cursor[1] * 2.0f / in.size[1];
+                }
+            }
+            
+            state.scale += in.wheel - wheel;
+            wheel = in.wheel;
+            
+            state.time = next;
+            state.angle = static_cast<GLfloat>(next);
+            state.inputTime = in.time;
+            
+            Frame &frame(frames.write());
+            frame.previous = previous;
+            frame.current = state;
+            frames.publish();
+        }
+    }
+    
+public:
+    // 時刻 now に表示する状態を最新の二つの状態の補間で求める
+    State snapshot(double now){
+        frames.update();
+        const Frame &frame(frames.read());
+        
+        const GLfloat t(static_cast<GLfloat>(std::min(std::max((now - frame.current.time) / step, 0.0), 1.0)));
+        const State &p(frame.previous), &c(frame.current);
+        
+        State s(c);
+        s.location[0] = p.location[0] + (c.location[0] - p.location[0]) * t;
+        s.location[1] = p.location[1] + (c.location[1] - p.location[1]) * t;
+        s.scale = p.scale + (c.scale - p.scale) * t;
+        s.angle = p.angle + (c.angle - p.angle) * t;
+        
+        return s;
+    }
+    
+    double getStep() const{
+        return step;
+    }
+};
@@ -0,0 +1,34 @@
+#pragma once
+#include <vector>
+#include <GL/glew.h>
+#include "Matrix.h"
+
+// 関節の階層. 親の関節は必ず子の関節より前に並べる
+class Skeleton{
+    // 親の関節の番号 (根は -1)
+    std::vector<int> parent;
+    
+    // バインドポーズの関節の座標系への変換
+    std::vector<Matrix> inverseBind;
+    
+public:
+    Skeleton(int count, const int *parent, const Matrix *inverseBind)
+    : parent(parent, parent + count), inverseBind(inverseBind, inverseBind + count){
+        
+    }
+    
+    int size() const{
+        return static_cast<int>(parent.size());
+    }
+    
+    // 各関節のローカルな変換 transform をモデル座標系への変換に置き換え,
+    // 頂点に掛けるスキニング行列を palette に求める
+    void pose(Matrix *transform, Matrix *palette) const{
+        for (int i = 0; i < size(); ++i) {
+            if (parent[i] >= 0) {
+                transform[i] = transform[parent[i]] * transform[i];
+            }
+            palette[i] = transform[i] * inverseBind[i];
+        }
+    }
+};
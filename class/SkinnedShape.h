@@ -0,0 +1,183 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <GL/glew.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+#include "Matrix.h"
+#include "Object.h"
+#include "ResourcePool.h"
+#include "Std140.h"
+#include "ThreadPool.h"
+
+// 関節の動きに合わせて変形する形状
+// CPU で変形してストリーミング用のバッファに書き込む方法と,
+// 行列パレットをユニフォームバッファに置いてバーテックスシェーダで変形する方法がある
+class SkinnedShape{
+public:
+    // 一つの形状が使える関節の数 (skin.vert の maxJoints と合わせる)
+    static constexpr int maxJoints = 64;
+    
+    struct Vertex{
+        GLfloat position[3];
+        GLfloat normal[3];
+        
+        // 影響を受ける関節の番号と重み (重みは合計が 255)
+        GLubyte joints[4];
+        GLubyte weights[4];
+    };
+    
+    // layout (std140) uniform Palette に渡す行列パレット
+    struct Palette{
+        Matrix joint[maxJoints];
+    };
+    
+    static_assert(sizeof(Matrix) == Std140Type<Matrix>::size, "Matrix must be tightly packed for std140 mat4 arrays");
+    
+private:
+    // CPU で変形するときの元の頂点
+    const std::vector<Vertex> vertex;
+    
+    const GLsizei indexcount;
+    
+    // [0] は GPU で変形する頂点配列, [1] は CPU で変形した結果を描く頂点配列
+    GLuint vao[2];
+    ResourcePool::Buffer vbo[2];
+    ResourcePool::Buffer ibo;
+    
+public:
+    SkinnedShape(GLsizei vertexcount, const Vertex *vertex, GLsizei indexcount, const GLuint *index)
+    : vertex(vertex, vertex + vertexcount), indexcount(indexcount){
+        ResourcePool &pool(ResourcePool::instance());
+        
+        vao[0] = pool.createVertexArray();
+        
+        vbo[0] = pool.createBuffer(GL_ARRAY_BUFFER, vertexcount * sizeof(Vertex), vertex);
+        
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), static_cast<Vertex *>(0)->position);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), static_cast<Vertex *>(0)->normal);
+        glEnableVertexAttribArray(1);
+        glVertexAttribIPointer(2, 4, GL_UNSIGNED_BYTE, sizeof(Vertex), static_cast<Vertex *>(0)->joints);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), static_cast<Vertex *>(0)->weights);
+        glEnableVertexAttribArray(3);
+        
+        ibo = pool.createBuffer(GL_ELEMENT_ARRAY_BUFFER, indexcount * sizeof(GLuint), index);
+        
+        vao[1] = pool.createVertexArray();
+        
+        vbo[1] = pool.createBuffer(GL_ARRAY_BUFFER, vertexcount * sizeof(Object::Vertex), NULL, GL_STREAM_DRAW);
+        
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Object::Vertex), static_cast<Object::Vertex *>(0)->position);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Object::Vertex), static_cast<Object::Vertex *>(0)->normal);
+        glEnableVertexAttribArray(1);
+        
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo.name);
+    }
+    
+    virtual ~SkinnedShape(){
+        ResourcePool &pool(ResourcePool::instance());
+        for (int i = 0; i < 2; ++i) {
+            pool.releaseVertexArray(vao[i]);
+            pool.releaseBuffer(vbo[i]);
+        }
+        pool.releaseBuffer(ibo);
+    }
+    
+private:
+    SkinnedShape(const SkinnedShape &s);
+    SkinnedShape &operator=(const SkinnedShape &s);
+    
+public:
+    // 頂点 in[0, count) を palette で変形して out に書き込む
+    static void skin(const Matrix *palette, const Vertex *in, Object::Vertex *out, size_t count){
+        for (size_t v = 0; v < count; ++v) {
+            const Vertex &s(in[v]);
+            Object::Vertex &d(out[v]);
+            
+#if defined(__SSE__)
+            // 重みを掛けた行列の和を列ごとに求める
+            __m128 c[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+            for (int i = 0; i < 4; ++i) {
+                if (s.weights[i] == 0) continue;
+                
+                const __m128 w(_mm_set1_ps(s.weights[i] * (1.0f / 255.0f)));
+                const GLfloat *const m(palette[s.joints[i]].data());
+                for (int k = 0; k < 4; ++k) {
+                    c[k] = _mm_add_ps(c[k], _mm_mul_ps(w, _mm_loadu_ps(m + k * 4)));
+                }
+            }
+            
+            const __m128 p(_mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(c[0], _mm_set1_ps(s.position[0])),
+                _mm_mul_ps(c[1], _mm_set1_ps(s.position[1]))), _mm_add_ps(
+                _mm_mul_ps(c[2], _mm_set1_ps(s.position[2])), c[3])));
+            const __m128 n(_mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(c[0], _mm_set1_ps(s.normal[0])),
+                _mm_mul_ps(c[1], _mm_set1_ps(s.normal[1]))),
+                _mm_mul_ps(c[2], _mm_set1_ps(s.normal[2]))));
+            
+            alignas(16) GLfloat pn[8];
+            _mm_store_ps(pn, p);
+            _mm_store_ps(pn + 4, n);
+            d.position[0] = pn[0]; d.position[1] = pn[1]; d.position[2] = pn[2];
+            d.normal[0] = pn[4]; d.normal[1] = pn[5]; d.normal[2] = pn[6];
+#else
+            GLfloat c[16] = {};
+            for (int i = 0; i < 4; ++i) {
+                if (s.weights[i] == 0) continue;
+                
+                const GLfloat w(s.weights[i] * (1.0f / 255.0f));
+                const GLfloat *const m(palette[s.joints[i]].data());
+                for (int k = 0; k < 16; ++k) {
+                    c[k] += w * m[k];
+                }
+            }
+            
+            for (int k = 0; k < 3; ++k) {
+                d.position[k] = c[k] * s.position[0] + c[4 + k] * s.position[1] + c[8 + k] * s.position[2] + c[12 + k];
+                d.normal[k] = c[k] * s.normal[0] + c[4 + k] * s.normal[1] + c[8 + k] * s.normal[2];
+            }
+#endif
+        }
+    }
+    
+    // CPU で変形して描画する
+    void draw(const Matrix *palette, ThreadPool &pool) const{
+        const size_t count(vertex.size());
+        
+        // 前のフレームの描画を待たないように新しい領域に置き換える
+        glBindBuffer(GL_ARRAY_BUFFER, vbo[1].name);
+        glBufferData(GL_ARRAY_BUFFER, vbo[1].capacity, NULL, GL_STREAM_DRAW);
+        Object::Vertex *const out(static_cast<Object::Vertex *>(glMapBufferRange(GL_ARRAY_BUFFER, 0,
+            count * sizeof(Object::Vertex), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT)));
+        
+        if (out != NULL) {
+            const Vertex *const in(vertex.data());
+            pool.parallel(count, 4096, [=](size_t begin, size_t end){
+                skin(palette, in + begin, out + begin, end - begin);
+            });
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        
+        ResourcePool &resources(ResourcePool::instance());
+        resources.touch(vbo[1]);
+        resources.touch(ibo);
+        
+        glBindVertexArray(vao[1]);
+        glDrawElements(GL_TRIANGLES, indexcount, GL_UNSIGNED_INT, 0);
+    }
+    
+    // バーテックスシェーダで変形して描画する. 行列パレットはあらかじめ Uniform<Palette> で select しておく
+    void draw() const{
+        ResourcePool &pool(ResourcePool::instance());
+        pool.touch(vbo[0]);
+        pool.touch(ibo);
+        
+        glBindVertexArray(vao[0]);
+        glDrawElements(GL_TRIANGLES, indexcount, GL_UNSIGNED_INT, 0);
+    }
+};
@@ -7,6 +7,10 @@ public :
     SolidShapeIndex(GLint size, GLsizei vertexcount, const Object::Vertex *vertex, GLsizei indexcount, const GLuint *index)
     : ShapeIndex(size, vertexcount, vertex, indexcount, index){
     }
+    
+    SolidShapeIndex(GLint size, const EncodedMesh &mesh)
+    : ShapeIndex(size, mesh){
+    }
 
     virtual void execute() const{
         glDrawElements(GL_TRIANGLES, indexcount, GL_UNSIGNED_INT, 0);
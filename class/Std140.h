@@ -0,0 +1,61 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <GL/glew.h>
+#include "Matrix.h"
+
+// std140 レイアウトでの型の基本アラインメントと大きさ
+template <typename T>
+struct Std140Type;
+
+template <>
+struct Std140Type<GLfloat>{
+    static constexpr size_t alignment = 4, size = 4;
+};
+
+template <>
+struct Std140Type<GLint>{
+    static constexpr size_t alignment = 4, size = 4;
+};
+
+template <size_t N>
+struct Std140Type<std::array<GLfloat, N>>{
+    static_assert(N >= 1 && N <= 4, "only scalars and vectors are supported");
+    static constexpr size_t alignment = N == 1 ? 4 : N == 2 ? 8 : 16, size = 4 * N;
+};
+
+template <>
+struct Std140Type<Matrix>{
+    static constexpr size_t alignment = 16, size = 64;
+};
+
+// C++ の構造体のメンバの位置が std140 の規則どおりか調べる
+// static_assert(Std140::matches<メンバの型...>({ offsetof(構造体, メンバ)... }), "...") のように使う
+class Std140{
+    static constexpr size_t roundUp(size_t offset, size_t alignment){
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+    
+public:
+    template <typename... Members>
+    static constexpr bool matches(std::initializer_list<size_t> offsets){
+        const size_t alignment[] = { Std140Type<Members>::alignment... };
+        const size_t size[] = { Std140Type<Members>::size... };
+        
+        if (offsets.size() != sizeof...(Members)) {
+            return false;
+        }
+        
+        size_t expected(0);
+        for (size_t i = 0; i < sizeof...(Members); ++i) {
+            expected = roundUp(expected, alignment[i]);
+            if (offsets.begin()[i] != expected) {
+                return false;
+            }
+            expected += size[i];
+        }
+        
+        return true;
+    }
+};
@@ -0,0 +1,148 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "FrameArena.h"
+
+// 範囲 [0, count) を分割してワーカースレッドと呼び出し元のスレッドで並列に処理する
+// 仕事の受け渡しにヒープを使わないので毎フレーム呼んでもよい
+// parallel() はそのフレームの中で終わるので, ワーカーの FrameArena はフレームに合わせて空に戻る
+class ThreadPool{
+    struct Job{
+        void (*run)(const void *f, size_t begin, size_t end);
+        const void *f;
+        size_t count;
+        size_t grain;
+        std::atomic<size_t> next;
+        std::atomic<size_t> done;
+    };
+    
+    std::vector<std::thread> workers;
+    
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    
+    Job *job;
+    
+    // 新しい仕事を出すたびに増やす
+    unsigned long generation;
+    
+    // 仕事に取りかかっているワーカーの数
+    unsigned int active;
+    
+    bool stopping;
+    
+    template <typename F>
+    static void invoke(const void *f, size_t begin, size_t end){
+        (*static_cast<const F *>(f))(begin, end);
+    }
+    
+    static void work(Job &j){
+        for (;;) {
+            const size_t begin(j.next.fetch_add(j.grain));
+            if (begin >= j.count) {
+                break;
+            }
+            
+            const size_t end(std::min(begin + j.grain, j.count));
+            j.run(j.f, begin, end);
+            j.done.fetch_add(end - begin);
+        }
+    }
+    
+    void loop(){
+        FrameArena::local().followFrames();
+        
+        unsigned long seen(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        
+        for (;;) {
+            wake.wait(lock, [&]{ return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            
+            seen = generation;
+            if (job == NULL) {
+                continue;
+            }
+            
+            Job &j(*job);
+            ++active;
+            lock.unlock();
+            work(j);
+            lock.lock();
+            --active;
+            finished.notify_all();
+        }
+    }
+    
+public:
+    ThreadPool(unsigned int count = std::max(std::thread::hardware_concurrency(), 2u) - 1)
+    : job(NULL), generation(0), active(0), stopping(false){
+        for (unsigned int i = 0; i < count; ++i) {
+            workers.emplace_back(&ThreadPool::loop, this);
+        }
+    }
+    
+    virtual ~ThreadPool(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        
+        for (std::thread &w : workers) {
+            w.join();
+        }
+    }
+    
+private:
+    ThreadPool(const ThreadPool &p);
+    ThreadPool &operator=(const ThreadPool &p);
+    
+public:
+    unsigned int size() const{
+        return static_cast<unsigned int>(workers.size()) + 1;
+    }
+    
+    // f(begin, end) を grain 個ずつに分けた範囲で呼び, すべて終わるまで待つ
+    template <typename F>
+    void parallel(size_t count, size_t grain, const F &f){
+        if (count == 0) {
+            return;
+        }
+        
+        grain = std::max<size_t>(grain, 1);
+        if (workers.empty() || count <= grain) {
+            f(0, count);
+            return;
+        }
+        
+        Job j;
+        j.run = &invoke<F>;
+        j.f = &f;
+        j.count = count;
+        j.grain = grain;
+        j.next.store(0);
+        j.done.store(0);
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &j;
+            ++generation;
+        }
+        wake.notify_all();
+        
+        work(j);
+        
+        std::unique_lock<std::mutex> lock(mutex);
+        job = NULL;
+        finished.wait(lock, [&]{ return active == 0 && j.done.load() == count; });
+    }
+};
@@ -0,0 +1,220 @@
+#pragma once
+#include <cmath>
+#include <vector>
+#include <GL/glew.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+#include "BVH.h"
+#include "Object.h"
+#include "Ray.h"
+#include "ThreadPool.h"
+
+// SolidShapeIndex と同じ頂点と指標の三角形に対する BVH
+// GPU から読み戻さずに CPU 側の写しで光線との交差を求める
+class TriangleBVH{
+    // 交差判定に使う形で BVH の葉の順に並べた三角形
+    struct Triangle{
+        GLfloat v0[3];
+        GLfloat e1[3];
+        GLfloat e2[3];
+    };
+    
+    BVH bvh;
+    std::vector<Triangle> triangles;
+    
+    static void cross(const GLfloat *a, const GLfloat *b, GLfloat *c){
+        c[0] = a[1] * b[2] - a[2] * b[1];
+        c[1] = a[2] * b[0] - a[0] * b[2];
+        c[2] = a[0] * b[1] - a[1] * b[0];
+    }
+    
+    static GLfloat dot(const GLfloat *a, const GLfloat *b){
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+    
+    // Moller-Trumbore 法. 裏からでも当たる
+    void intersectTriangle(uint32_t i, const Ray &ray, Hit &hit) const{
+        const Triangle &tri(triangles[i]);
+        
+        GLfloat p[3];
+        cross(ray.direction, tri.e2, p);
+        const GLfloat det(dot(tri.e1, p));
+        if (std::fabs(det) < 1.0e-12f) {
+            return;
+        }
+        const GLfloat inv(1.0f / det);
+        
+        const GLfloat s[3] = { ray.origin[0] - tri.v0[0], ray.origin[1] - tri.v0[1], ray.origin[2] - tri.v0[2] };
+        const GLfloat u(dot(s, p) * inv);
+        if (u < 0.0f || u > 1.0f) {
+            return;
+        }
+        
+        GLfloat q[3];
+        cross(s, tri.e1, q);
+        const GLfloat v(dot(ray.direction, q) * inv);
+        if (v < 0.0f || u + v > 1.0f) {
+            return;
+        }
+        
+        const GLfloat t(dot(tri.e2, q) * inv);
+        if (t > 0.0f && t < hit.t) {
+            hit.t = t;
+            hit.triangle = static_cast<GLint>(bvh.getOrder()[i]);
+            hit.u = u;
+            hit.v = v;
+        }
+    }
+
+public:
+    // vertex と index は SolidShapeIndex に渡したものと同じ. pool があれば並列に作る
+    TriangleBVH(const Object::Vertex *vertex, GLsizei indexcount, const GLuint *index, ThreadPool *pool = NULL)
+    : triangles(indexcount / 3){
+        const size_t count(triangles.size());
+        std::vector<BVH::Bounds> boxes(count);
+        
+        const auto bound = [&](size_t begin, size_t end){
+            for (size_t i = begin; i < end; ++i) {
+                const GLfloat *const p[3] = {
+                    vertex[index[3 * i]].position, vertex[index[3 * i + 1]].position, vertex[index[3 * i + 2]].position
+                };
+                
+                boxes[i] = BVH::Bounds::empty();
+                for (const GLfloat *v : p) {
+                    boxes[i].grow(v);
+                }
+            }
+        };
+        if (pool != NULL) {
+            pool->parallel(count, 4096, bound);
+        } else {
+            bound(0, count);
+        }
+        
+        bvh.build(boxes, pool);
+        
+        // 葉の順に並べておくと辿るときに近くのメモリを読む
+        const std::vector<GLuint> &order(bvh.getOrder());
+        const auto arrange = [&](size_t begin, size_t end){
+            for (size_t i = begin; i < end; ++i) {
+                const GLuint *const t(index + 3 * order[i]);
+                const GLfloat *const a(vertex[t[0]].position), *const b(vertex[t[1]].position), *const c(vertex[t[2]].position);
+                
+                Triangle &tri(triangles[i]);
+                for (int k = 0; k < 3; ++k) {
+                    tri.v0[k] = a[k];
+                    tri.e1[k] = b[k] - a[k];
+                    tri.e2[k] = c[k] - a[k];
+                }
+            }
+        };
+        if (pool != NULL) {
+            pool->parallel(count, 4096, arrange);
+        } else {
+            arrange(0, count);
+        }
+    }
+    
+    virtual ~TriangleBVH(){
+    
+    }
+
+private:
+    TriangleBVH(const TriangleBVH &b);
+    TriangleBVH &operator=(const TriangleBVH &b);
+
+public:
+    BVH::Bounds bounds() const{
+        return bvh.bounds();
+    }
+    
+    // hit.t より手前で当たれば hit を書き換えて true を返す
+    bool intersect(const Ray &ray, Hit &hit) const{
+        const GLfloat t(hit.t);
+        bvh.intersect(ray, hit, [&](uint32_t i){ intersectTriangle(i, ray, hit); });
+        return hit.t < t;
+    }
+    
+    // 4 本の光線をまとめて調べる. 当たった光線のビットを返す
+    int intersect(const Ray *ray, Hit *hit) const{
+        const GLfloat t[4] = { hit[0].t, hit[1].t, hit[2].t, hit[3].t };
+
+#if defined(__SSE__)
+        __m128 o[3], d[3];
+        for (int k = 0; k < 3; ++k) {
+            o[k] = _mm_setr_ps(ray[0].origin[k], ray[1].origin[k], ray[2].origin[k], ray[3].origin[k]);
+            d[k] = _mm_setr_ps(ray[0].direction[k], ray[1].direction[k], ray[2].direction[k], ray[3].direction[k]);
+        }
+        const __m128 zero(_mm_setzero_ps()), one(_mm_set1_ps(1.0f));
+        
+        bvh.intersect(ray, hit, [&](uint32_t i, int mask){
+            const Triangle &tri(triangles[i]);
+            const __m128 e1[3] = { _mm_set1_ps(tri.e1[0]), _mm_set1_ps(tri.e1[1]), _mm_set1_ps(tri.e1[2]) };
+            const __m128 e2[3] = { _mm_set1_ps(tri.e2[0]), _mm_set1_ps(tri.e2[1]), _mm_set1_ps(tri.e2[2]) };
+            
+            // p = d x e2
+            const __m128 p[3] = {
+                _mm_sub_ps(_mm_mul_ps(d[1], e2[2]), _mm_mul_ps(d[2], e2[1])),
+                _mm_sub_ps(_mm_mul_ps(d[2], e2[0]), _mm_mul_ps(d[0], e2[2])),
+                _mm_sub_ps(_mm_mul_ps(d[0], e2[1]), _mm_mul_ps(d[1], e2[0]))
+            };
+            const __m128 det(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e1[0], p[0]), _mm_mul_ps(e1[1], p[1])), _mm_mul_ps(e1[2], p[2])));
+            const __m128 inv(_mm_div_ps(one, det));
+            
+            const __m128 s[3] = {
+                _mm_sub_ps(o[0], _mm_set1_ps(tri.v0[0])),
+                _mm_sub_ps(o[1], _mm_set1_ps(tri.v0[1])),
+                _mm_sub_ps(o[2], _mm_set1_ps(tri.v0[2]))
+            };
+            const __m128 u(_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(s[0], p[0]), _mm_mul_ps(s[1], p[1])), _mm_mul_ps(s[2], p[2])), inv));
+            
+            // q = s x e1
+            const __m128 q[3] = {
+                _mm_sub_ps(_mm_mul_ps(s[1], e1[2]), _mm_mul_ps(s[2], e1[1])),
+                _mm_sub_ps(_mm_mul_ps(s[2], e1[0]), _mm_mul_ps(s[0], e1[2])),
+                _mm_sub_ps(_mm_mul_ps(s[0], e1[1]), _mm_mul_ps(s[1], e1[0]))
+            };
+            const __m128 v(_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], q[0]), _mm_mul_ps(d[1], q[1])), _mm_mul_ps(d[2], q[2])), inv));
+            const __m128 t(_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2[0], q[0]), _mm_mul_ps(e2[1], q[1])), _mm_mul_ps(e2[2], q[2])), inv));
+            
+            const __m128 closest(_mm_setr_ps(hit[0].t, hit[1].t, hit[2].t, hit[3].t));
+            __m128 ok(_mm_cmpge_ps(u, zero));
+            ok = _mm_and_ps(ok, _mm_cmpge_ps(v, zero));
+            ok = _mm_and_ps(ok, _mm_cmple_ps(_mm_add_ps(u, v), one));
+            ok = _mm_and_ps(ok, _mm_cmpgt_ps(t, zero));
+            ok = _mm_and_ps(ok, _mm_cmplt_ps(t, closest));
+            
+            const int m(_mm_movemask_ps(ok) & mask);
+            if (m == 0) {
+                return;
+            }
+            
+            alignas(16) GLfloat tt[4], uu[4], vv[4];
+            _mm_store_ps(tt, t);
+            _mm_store_ps(uu, u);
+            _mm_store_ps(vv, v);
+            for (int k = 0; k < 4; ++k) {
+                if (m & (1 << k)) {
+                    hit[k].t = tt[k];
+                    hit[k].triangle = static_cast<GLint>(bvh.getOrder()[i]);
+                    hit[k].u = uu[k];
+                    hit[k].v = vv[k];
+                }
+            }
+        });
+#else
+        bvh.intersect(ray, hit, [&](uint32_t i, int mask){
+            for (int k = 0; k < 4; ++k) {
+                if (mask & (1 << k)) intersectTriangle(i, ray[k], hit[k]);
+            }
+        });
+#endif
+
+        int result(0);
+        for (int k = 0; k < 4; ++k) {
+            if (hit[k].t < t[k]) result |= 1 << k;
+        }
+        return result;
+    }
+};
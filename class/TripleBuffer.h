@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+
+// 書き込み側と読み出し側が互いを待たずに最新の値を受け渡すトリプルバッファ
+// 書き込みと読み出しはそれぞれ一つのスレッドからだけ行う
+template <typename T>
+class TripleBuffer{
+    T buffer[3];
+    
+    // 下位 2 ビットが受け渡し中のバッファの番号, 3 ビット目が未読のしるし
+    std::atomic<unsigned int> middle;
+    
+    // 書き込み側だけが使うバッファの番号
+    unsigned int back;
+    
+    // 読み出し側だけが使うバッファの番号
+    unsigned int front;
+    
+    static constexpr unsigned int fresh = 4;
+    
+public:
+    TripleBuffer()
+    : buffer(), middle(1), back(0), front(2){
+        
+    }
+    
+private:
+    TripleBuffer(const TripleBuffer &t);
+    TripleBuffer &operator=(const TripleBuffer &t);
+    
+public:
+    // 書き込み側が次に公開する値を作るバッファ
+    T &write(){
+        return buffer[back];
+    }
+    
+    // write() で作った値を読み出し側に公開する
+    void publish(){
+        back = middle.exchange(back | fresh, std::memory_order_acq_rel) & 3;
+    }
+    
+    // 新しい値が公開されていれば読み出し側のバッファと交換する
+    bool update(){
+        if ((middle.load(std::memory_order_relaxed) & fresh) == 0) {
+            return false;
+        }
+        
+        front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+        return true;
+    }
+    
+    // update() で受け取った最新の値
+    const T &read() const{
+        return buffer[front];
+    }
+};
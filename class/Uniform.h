@@ -1,11 +1,14 @@
 #pragma once
-#include <memory>
+#include <cstring>
 #include <GL/glew.h>
+#include "FrameArena.h"
+#include "Handle.h"
+#include "ResourcePool.h"
 
 template <typename T>
 class Uniform {
     struct UniformBuffer{
-        GLuint ubo;
+        ResourcePool::Buffer ubo;
         
         GLsizeiptr blocksize;
         
@@ -15,9 +18,7 @@ class Uniform {
             glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, & alignment);
             blocksize = (((sizeof(T) - 1) / alignment) + 1) * alignment;
             
-            glGenBuffers(1, &ubo);
-            glBindBuffer(GL_UNIFORM_BUFFER, ubo);
-            glBufferData(GL_UNIFORM_BUFFER, count * blocksize, NULL, GL_STATIC_DRAW);
+            ubo = ResourcePool::instance().createBuffer(GL_UNIFORM_BUFFER, count * blocksize, NULL);
             
             for (unsigned int i = 0; i < count; ++i) {
                 glBufferSubData(GL_UNIFORM_BUFFER, i * blocksize, sizeof(T), data + i);
@@ -25,15 +26,15 @@ class Uniform {
         }
         
         ~UniformBuffer(){
-            glDeleteBuffers(1, &ubo);
+            ResourcePool::instance().releaseBuffer(ubo);
         }
     };
     
-    const std::shared_ptr<const UniformBuffer> buffer;
+    const Handle<const UniformBuffer> buffer;
     
 public:
     Uniform(const T *data = NULL, unsigned int count = 1)
-        : buffer(new UniformBuffer(data, count)){
+        : buffer(Handle<const UniformBuffer>::make(data, count)){
         
     }
     
@@ -42,14 +43,25 @@ public:
     }
     
     void set(const T * data, unsigned int start = 0, unsigned int count = 1) const{
-        glBindBuffer(GL_UNIFORM_BUFFER, buffer->ubo);
-
+        ResourcePool::instance().touch(buffer->ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer->ubo.name);
+        
+        if (count <= 1) {
+            if (count == 1) glBufferSubData(GL_UNIFORM_BUFFER, start * buffer->blocksize, sizeof(T), data);
+            return;
+        }
+        
+        // ブロックの間隔に並べ直してから一度に送る. 並べ直す場所はこのフレームの間だけ使う
+        const GLsizeiptr size((count - 1) * buffer->blocksize + sizeof(T));
+        unsigned char *const staging(static_cast<unsigned char *>(FrameArena::local().allocate(size, alignof(T))));
         for (unsigned int i = 0; i < count; ++i) {
-            glBufferSubData(GL_UNIFORM_BUFFER, i * buffer->blocksize, sizeof(T), data + i);
+            std::memcpy(staging + i * buffer->blocksize, data + i, sizeof(T));
         }
+        glBufferSubData(GL_UNIFORM_BUFFER, start * buffer->blocksize, size, staging);
     }
     
     void select(GLuint bp, unsigned int i = 0) const{
-        glBindBufferRange(GL_UNIFORM_BUFFER, bp, buffer->ubo, i * buffer->blocksize, sizeof(T));
+        ResourcePool::instance().touch(buffer->ubo);
+        glBindBufferRange(GL_UNIFORM_BUFFER, bp, buffer->ubo.name, i * buffer->blocksize, sizeof(T));
     }
 };
@@ -2,24 +2,47 @@
 #include <iostream>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include "FramePacer.h"
+#include "ResourcePool.h"
+#include "TripleBuffer.h"
+#include "../gltrace.hpp"
+#include "../log.hpp"
 
 class Window {
+public:
+    // 描画スレッドでサンプリングしてシミュレーションスレッドに渡す入力
+    struct Input{
+        GLfloat size[2];
+        GLfloat cursor[2];
+        
+        // ホイールの累積量
+        GLfloat wheel;
+        
+        bool left, right, down, up, button;
+        
+        // サンプリングした時刻
+        double time;
+    };
+    
+private:
     GLFWwindow *const window;
     
     GLfloat size[2];
     
-    GLfloat scale;
+    GLfloat wheelTotal;
     
-    GLfloat location[2];
+    TripleBuffer<Input> input;
+    
+    FramePacer pacer;
     
     int keyStatus;
     
 public:
     Window(int width = 640, int height = 480, const char *title = "Hello!")
     : window(glfwCreateWindow(width, height, title, NULL, NULL))
-    , scale(100.0f), location{0.0f, 0.0f}, keyStatus(GLFW_RELEASE) {
+    , wheelTotal(0.0f), keyStatus(GLFW_RELEASE) {
         if (window == NULL) {
-            std::cerr << "cant create GLFW window" << std::endl;
+            logMessage(LOG_FATAL, LOG_WINDOW, "cant create GLFW window");
             exit(1);
         }
         
@@ -27,11 +50,11 @@ public:
         
         glewExperimental = GL_TRUE;
         if (glewInit() != GLEW_OK) {
-            std::cerr << "cant initialize GLEW" << std::endl;
+            logMessage(LOG_FATAL, LOG_WINDOW, "cant initialize GLEW");
             exit(1);
         }
         
-        glfwSwapInterval(1);
+        pacer.setMode(FramePacer::VSYNC);
         
         glfwSetWindowSizeCallback(window, resize);
 
@@ -42,39 +65,91 @@ public:
         glfwSetWindowUserPointer(window, this);
             
         resize(window, width, height);
+        
+        sampleInput();
     }
     
     virtual ~Window(){
+        // pacer のデストラクタはコンテキストが無くなってから走るので先に捨てる
+        pacer.release();
         glfwDestroyWindow(window);
     }
     
     explicit operator bool(){
         
+        pacer.beginFrame();
+        
         glfwPollEvents();
         
+        sampleInput();
+
+        return  !glfwWindowShouldClose(window) && !glfwGetKey(window, GLFW_KEY_ESCAPE);
+    }
+    
+private:
+    // 入力の状態をシミュレーションスレッドに公開する
+    void sampleInput(){
+        Input &in(input.write());
+        
+        in.size[0] = size[0];
+        in.size[1] = size[1];
+        in.wheel = wheelTotal;
         
-        if (glfwGetKey(window, GLFW_KEY_LEFT) != GLFW_RELEASE)
-            location[0] -= 2.0f / size[0];
-        else if (glfwGetKey(window, GLFW_KEY_RIGHT) != GLFW_RELEASE)
-            location[0] += 2.0f / size[0];
-        if (glfwGetKey(window, GLFW_KEY_DOWN) != GLFW_RELEASE)
-            location[1] -= 2.0f / size[1];
-        else if (glfwGetKey(window, GLFW_KEY_UP) != GLFW_RELEASE)
-            location[1] += 2.0f / size[1];
+        in.left = glfwGetKey(window, GLFW_KEY_LEFT) != GLFW_RELEASE;
+        in.right = glfwGetKey(window, GLFW_KEY_RIGHT) != GLFW_RELEASE;
+        in.down = glfwGetKey(window, GLFW_KEY_DOWN) != GLFW_RELEASE;
+        in.up = glfwGetKey(window, GLFW_KEY_UP) != GLFW_RELEASE;
+        in.button = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_1) != GLFW_RELEASE;
         
-        if(glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_1) != GLFW_RELEASE){
-            double x,y;
+        if (in.button) {
+            double x, y;
             glfwGetCursorPos(window, &x, &y);
             
-            location[0] = static_cast<GLfloat>(x) * 2.0f / size[0] - 1.0f;
-            location[1] = 1.0f - static_cast<GLfloat>(y) * 2.0f / size[1];
+            in.cursor[0] = static_cast<GLfloat>(x);
+            in.cursor[1] = static_cast<GLfloat>(y);
         }
-
-        return  !glfwWindowShouldClose(window) && !glfwGetKey(window, GLFW_KEY_ESCAPE);
+        
+        in.time = glfwGetTime();
+        
+        input.publish();
     }
     
-    void swapBuffers() const{
+public:
+    // inputTime はこのフレームに反映した入力のサンプリング時刻
+    void swapBuffers(double inputTime = 0.0){
+        traceFrame();
+        
+        pacer.beforeSwap();
         glfwSwapBuffers(window);
+        pacer.afterSwap(inputTime);
+        
+        ResourcePool::instance().endFrame();
+    }
+    
+    // 右ボタンを押している間 true を返し, カーソルの位置を正規化デバイス座標で ndc に求める
+    bool getPickCursor(GLfloat *ndc) const{
+        if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_2) == GLFW_RELEASE) {
+            return false;
+        }
+        
+        double x, y;
+        glfwGetCursorPos(window, &x, &y);
+        
+        ndc[0] = static_cast<GLfloat>(x) * 2.0f / size[0] - 1.0f;
+        ndc[1] = 1.0f - static_cast<GLfloat>(y) * 2.0f / size[1];
+        return true;
+    }
+    
+    void setPresentMode(FramePacer::Mode mode, int maxFrames = 1){
+        pacer.setMode(mode, maxFrames);
+    }
+    
+    void setFrameLimit(double fps){
+        pacer.setLimit(fps);
+    }
+    
+    const FramePacer::Timing &getTiming() const{
+        return pacer.getTiming();
     }
     
     static void resize(GLFWwindow *const window, int width, int height){
@@ -95,7 +170,7 @@ public:
         Window *const instance(static_cast<Window *>(glfwGetWindowUserPointer(window)));
         
         if (instance != NULL){
-            instance->scale += static_cast<GLfloat>(y);
+            instance->wheelTotal += static_cast<GLfloat>(y);
         }
     }
     
@@ -111,11 +186,7 @@ public:
         return size;
     }
     
-    GLfloat getScale() const {
-        return scale;
-    }
-
-    const GLfloat *getLocation() const {
-        return location;
+    TripleBuffer<Input> &getInput() {
+        return input;
     }
 };
@@ -0,0 +1,962 @@
+// このファイルの中では GL 1.1 の関数を置き換えずに元の関数を呼ぶ
+#define GLTRACE_NO_REDIRECT
+#include "gltrace.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+// 記録の形式
+//   "GLTR" と版 (4 バイト) に続けて呼び出しを順に並べる
+//   一つの呼び出しは種類の 1 バイトと, 種類ごとに決まった数の引数を zigzag した可変長整数で並べたもの
+//   中身を持つ呼び出しはその後に 8 バイトのハッシュを置き, 中身は初めて現れたときに BLOB として前に書く
+//   オブジェクトの名前は記録したときのもので, 呼び直すときに作り直した名前に置き換える
+namespace {
+    enum Op : unsigned char{
+        BLOB, FRAME,
+        GEN_BUFFER, DELETE_BUFFER, BIND_BUFFER, BUFFER_DATA, BUFFER_SUB_DATA, MAP_WRITE, BIND_BUFFER_BASE, BIND_BUFFER_RANGE,
+        GEN_VERTEX_ARRAY, DELETE_VERTEX_ARRAY, BIND_VERTEX_ARRAY,
+        VERTEX_ATTRIB_POINTER, VERTEX_ATTRIB_IPOINTER, ENABLE_VERTEX_ATTRIB_ARRAY, DISABLE_VERTEX_ATTRIB_ARRAY,
+        CREATE_SHADER, SHADER_SOURCE, COMPILE_SHADER, ATTACH_SHADER, DELETE_SHADER,
+        CREATE_PROGRAM, BIND_ATTRIB_LOCATION, BIND_FRAG_DATA_LOCATION, TRANSFORM_FEEDBACK_VARYINGS,
+        LINK_PROGRAM, DELETE_PROGRAM, USE_PROGRAM, GET_UNIFORM_LOCATION, UNIFORM_BLOCK_BINDING,
+        UNIFORM_1FV, UNIFORM_1IV, UNIFORM_2FV, UNIFORM_3FV, UNIFORM_4FV, UNIFORM_MATRIX_3FV, UNIFORM_MATRIX_4FV,
+        BEGIN_TRANSFORM_FEEDBACK, END_TRANSFORM_FEEDBACK,
+        DRAW_ARRAYS, DRAW_ELEMENTS, CLEAR, VIEWPORT, ENABLE, DISABLE, DEPTH_MASK, BLEND_FUNC,
+        CULL_FACE, FRONT_FACE, DEPTH_FUNC, CLEAR_COLOR, CLEAR_DEPTH,
+        OP_COUNT
+    };
+    
+    struct Call{
+        const char *name;
+        unsigned char argc;
+        bool blob;
+    };
+    
+    const Call calls[OP_COUNT] = {
+        { "blob", 0, false },
+        { "frame", 0, false },
+        { "glGenBuffers", 1, false },               // 名前
+        { "glDeleteBuffers", 1, false },            // 名前
+        { "glBindBuffer", 2, false },               // target, 名前
+        { "glBufferData", 3, true },                // target, size, usage
+        { "glBufferSubData", 3, true },             // target, offset, size
+        { "glMapBufferRange", 4, true },            // target, offset, length, access (書き込んだ中身を Unmap のときに記録する)
+        { "glBindBufferBase", 3, false },           // target, index, 名前
+        { "glBindBufferRange", 5, false },          // target, index, 名前, offset, size
+        { "glGenVertexArrays", 1, false },
+        { "glDeleteVertexArrays", 1, false },
+        { "glBindVertexArray", 1, false },
+        { "glVertexAttribPointer", 6, false },      // index, size, type, normalized, stride, offset
+        { "glVertexAttribIPointer", 5, false },     // index, size, type, stride, offset
+        { "glEnableVertexAttribArray", 1, false },
+        { "glDisableVertexAttribArray", 1, false },
+        { "glCreateShader", 2, false },             // type, 名前
+        { "glShaderSource", 1, true },              // 名前
+        { "glCompileShader", 1, false },
+        { "glAttachShader", 2, false },             // プログラム, シェーダ
+        { "glDeleteShader", 1, false },
+        { "glCreateProgram", 1, false },
+        { "glBindAttribLocation", 2, true },        // プログラム, index
+        { "glBindFragDataLocation", 2, true },      // プログラム, color
+        { "glTransformFeedbackVaryings", 3, true }, // プログラム, count, bufferMode
+        { "glLinkProgram", 1, false },
+        { "glDeleteProgram", 1, false },
+        { "glUseProgram", 1, false },
+        { "glGetUniformLocation", 2, true },        // プログラム, 返した場所
+        { "glUniformBlockBinding", 3, true },       // プログラム, ブロックの番号, 結合ポイント (中身はブロックの名前)
+        { "glUniform1fv", 2, true },                // 場所, count
+        { "glUniform1iv", 2, true },
+        { "glUniform2fv", 2, true },
+        { "glUniform3fv", 2, true },
+        { "glUniform4fv", 2, true },
+        { "glUniformMatrix3fv", 3, true },          // 場所, count, transpose
+        { "glUniformMatrix4fv", 3, true },
+        { "glBeginTransformFeedback", 1, false },
+        { "glEndTransformFeedback", 0, false },
+        { "glDrawArrays", 3, false },
+        { "glDrawElements", 4, false },             // mode, count, type, offset
+        { "glClear", 1, false },
+        { "glViewport", 4, false },
+        { "glEnable", 1, false },
+        { "glDisable", 1, false },
+        { "glDepthMask", 1, false },
+        { "glBlendFunc", 2, false },
+        { "glCullFace", 1, false },
+        { "glFrontFace", 1, false },
+        { "glDepthFunc", 1, false },
+        { "glClearColor", 4, false },               // float のビット
+        { "glClearDepth", 1, false }                // double のビット
+    };
+    
+    const char magic[4] = { 'G', 'L', 'T', 'R' };
+    const uint32_t version(2);
+    
+    uint64_t zigzag(int64_t v){
+        return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+    }
+    
+    int64_t unzigzag(uint64_t z){
+        return static_cast<int64_t>(z >> 1) ^ -static_cast<int64_t>(z & 1);
+    }
+    
+    unsigned char *putVarint(unsigned char *p, uint64_t v){
+        while (v >= 0x80) {
+            *p++ = static_cast<unsigned char>(v | 0x80);
+            v >>= 7;
+        }
+        *p++ = static_cast<unsigned char>(v);
+        return p;
+    }
+    
+    // 8 バイトずつ掛け算とシフトで混ぜる. 重複を見つけるためのもので暗号には使えない
+    // 0 は中身がないことを表すので返さない
+    uint64_t hashBytes(const void *data, size_t size){
+        const unsigned char *p(static_cast<const unsigned char *>(data));
+        uint64_t h(0x9e3779b97f4a7c15ull ^ size);
+        
+        for (; size >= 8; size -= 8, p += 8) {
+            uint64_t w;
+            std::memcpy(&w, p, 8);
+            h = (h ^ w) * 0xff51afd7ed558ccdull;
+            h ^= h >> 32;
+        }
+        
+        uint64_t w(0);
+        std::memcpy(&w, p, size);
+        h = (h ^ w) * 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 29;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+        
+        return h == 0 ? 1 : h;
+    }
+    
+    float floatOf(int64_t bits){
+        const uint32_t u(static_cast<uint32_t>(bits));
+        float f;
+        std::memcpy(&f, &u, 4);
+        return f;
+    }
+    
+    int64_t bitsOf(float f){
+        uint32_t u;
+        std::memcpy(&u, &f, 4);
+        return u;
+    }
+    
+    // 記録しているファイル. 記録していなければ NULL
+    FILE *trace(NULL);
+    
+    // 書いたバイト数 (中身を 8 バイト境界に揃えるのに使う)
+    uint64_t written(0);
+    
+    // 書いた中身のハッシュと大きさ
+    std::unordered_map<uint64_t, size_t> blobs;
+    uint64_t callCount(0), blobBytes(0), duplicateBytes(0);
+    
+    void write(const void *data, size_t size){
+        std::fwrite(data, 1, size, trace);
+        written += size;
+    }
+    
+    // 中身を初めて見たときだけ書き, ハッシュを返す
+    // 大きさの違う中身とハッシュがぶつかったら, 混ぜ直した空いているハッシュで新しい中身として書く
+    uint64_t blob(const void *data, size_t size){
+        if (data == NULL) {
+            return 0;
+        }
+        
+        uint64_t hash(hashBytes(data, size));
+        for (;;) {
+            const auto b(blobs.emplace(hash, size));
+            if (b.second) {
+                break;
+            }
+            if (b.first->second == size) {
+                duplicateBytes += size;
+                return hash;
+            }
+            hash = hashBytes(&hash, sizeof hash);
+        }
+        
+        unsigned char header[32];
+        unsigned char *p(header);
+        *p++ = BLOB;
+        p = putVarint(p, size);
+        std::memcpy(p, &hash, 8);
+        p += 8;
+        
+        // 呼び直すときにファイルを読んだまま float の配列として渡せるように中身を 8 バイト境界に置く
+        const size_t padding((8 - (written + (p - header) + 1) % 8) % 8);
+        *p++ = static_cast<unsigned char>(padding);
+        std::memset(p, 0, padding);
+        p += padding;
+        
+        write(header, p - header);
+        write(data, size);
+        blobBytes += size;
+        return hash;
+    }
+    
+    void emit(Op op, std::initializer_list<int64_t> args, uint64_t hash = 0){
+        unsigned char record[1 + 6 * 10 + 8];
+        unsigned char *p(record);
+        
+        *p++ = op;
+        for (const int64_t a : args) {
+            p = putVarint(p, zigzag(a));
+        }
+        if (calls[op].blob) {
+            std::memcpy(p, &hash, 8);
+            p += 8;
+        }
+        
+        write(record, p - record);
+        ++callCount;
+    }
+    
+    int64_t offsetOf(const void *pointer){
+        return static_cast<int64_t>(reinterpret_cast<uintptr_t>(pointer));
+    }
+    
+    // 書き込みのためにマップしている範囲
+    struct Mapping{
+        GLenum target;
+        GLintptr offset;
+        GLsizeiptr length;
+        GLbitfield access;
+        const void *pointer;
+    };
+    std::vector<Mapping> mappings;
+    
+    // GLEW の関数ポインタを差し替えたもの. 元の関数は real に残す
+    PFNGLGENBUFFERSPROC realGenBuffers;
+    PFNGLDELETEBUFFERSPROC realDeleteBuffers;
+    PFNGLBINDBUFFERPROC realBindBuffer;
+    PFNGLBUFFERDATAPROC realBufferData;
+    PFNGLBUFFERSUBDATAPROC realBufferSubData;
+    PFNGLMAPBUFFERRANGEPROC realMapBufferRange;
+    PFNGLUNMAPBUFFERPROC realUnmapBuffer;
+    PFNGLBINDBUFFERBASEPROC realBindBufferBase;
+    PFNGLBINDBUFFERRANGEPROC realBindBufferRange;
+    PFNGLGENVERTEXARRAYSPROC realGenVertexArrays;
+    PFNGLDELETEVERTEXARRAYSPROC realDeleteVertexArrays;
+    PFNGLBINDVERTEXARRAYPROC realBindVertexArray;
+    PFNGLVERTEXATTRIBPOINTERPROC realVertexAttribPointer;
+    PFNGLVERTEXATTRIBIPOINTERPROC realVertexAttribIPointer;
+    PFNGLENABLEVERTEXATTRIBARRAYPROC realEnableVertexAttribArray;
+    PFNGLDISABLEVERTEXATTRIBARRAYPROC realDisableVertexAttribArray;
+    PFNGLCREATESHADERPROC realCreateShader;
+    PFNGLSHADERSOURCEPROC realShaderSource;
+    PFNGLCOMPILESHADERPROC realCompileShader;
+    PFNGLATTACHSHADERPROC realAttachShader;
+    PFNGLDELETESHADERPROC realDeleteShader;
+    PFNGLCREATEPROGRAMPROC realCreateProgram;
+    PFNGLBINDATTRIBLOCATIONPROC realBindAttribLocation;
+    PFNGLBINDFRAGDATALOCATIONPROC realBindFragDataLocation;
+    PFNGLTRANSFORMFEEDBACKVARYINGSPROC realTransformFeedbackVaryings;
+    PFNGLLINKPROGRAMPROC realLinkProgram;
+    PFNGLDELETEPROGRAMPROC realDeleteProgram;
+    PFNGLUSEPROGRAMPROC realUseProgram;
+    PFNGLGETUNIFORMLOCATIONPROC realGetUniformLocation;
+    PFNGLUNIFORMBLOCKBINDINGPROC realUniformBlockBinding;
+    PFNGLUNIFORM1FVPROC realUniform1fv;
+    PFNGLUNIFORM1IVPROC realUniform1iv;
+    PFNGLUNIFORM2FVPROC realUniform2fv;
+    PFNGLUNIFORM3FVPROC realUniform3fv;
+    PFNGLUNIFORM4FVPROC realUniform4fv;
+    PFNGLUNIFORMMATRIX3FVPROC realUniformMatrix3fv;
+    PFNGLUNIFORMMATRIX4FVPROC realUniformMatrix4fv;
+    PFNGLBEGINTRANSFORMFEEDBACKPROC realBeginTransformFeedback;
+    PFNGLENDTRANSFORMFEEDBACKPROC realEndTransformFeedback;
+    
+    void GLAPIENTRY traceGenBuffers(GLsizei n, GLuint *buffers){
+        realGenBuffers(n, buffers);
+        for (GLsizei i = 0; i < n; ++i) {
+            emit(GEN_BUFFER, { buffers[i] });
+        }
+    }
+    
+    void GLAPIENTRY traceDeleteBuffers(GLsizei n, const GLuint *buffers){
+        for (GLsizei i = 0; i < n; ++i) {
+            emit(DELETE_BUFFER, { buffers[i] });
+        }
+        realDeleteBuffers(n, buffers);
+    }
+    
+    void GLAPIENTRY traceBindBuffer(GLenum target, GLuint buffer){
+        emit(BIND_BUFFER, { target, buffer });
+        realBindBuffer(target, buffer);
+    }
+    
+    void GLAPIENTRY traceBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage){
+        emit(BUFFER_DATA, { target, size, usage }, blob(data, size));
+        realBufferData(target, size, data, usage);
+    }
+    
+    void GLAPIENTRY traceBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data){
+        emit(BUFFER_SUB_DATA, { target, offset, size }, blob(data, size));
+        realBufferSubData(target, offset, size, data);
+    }
+    
+    // 読み出しのためのマップは記録しない
+    void *GLAPIENTRY traceMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access){
+        void *const pointer(realMapBufferRange(target, offset, length, access));
+        if (pointer != NULL && (access & GL_MAP_WRITE_BIT) != 0) {
+            const Mapping m = { target, offset, length, access, pointer };
+            mappings.push_back(m);
+        }
+        return pointer;
+    }
+    
+    GLboolean GLAPIENTRY traceUnmapBuffer(GLenum target){
+        for (auto m = mappings.begin(); m != mappings.end(); ++m) {
+            if (m->target == target) {
+                emit(MAP_WRITE, { m->target, m->offset, m->length, m->access }, blob(m->pointer, m->length));
+                mappings.erase(m);
+                break;
+            }
+        }
+        return realUnmapBuffer(target);
+    }
+    
+    void GLAPIENTRY traceBindBufferBase(GLenum target, GLuint index, GLuint buffer){
+        emit(BIND_BUFFER_BASE, { target, index, buffer });
+        realBindBufferBase(target, index, buffer);
+    }
+    
+    void GLAPIENTRY traceBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size){
+        emit(BIND_BUFFER_RANGE, { target, index, buffer, offset, size });
+        realBindBufferRange(target, index, buffer, offset, size);
+    }
+    
+    void GLAPIENTRY traceGenVertexArrays(GLsizei n, GLuint *arrays){
+        realGenVertexArrays(n, arrays);
+        for (GLsizei i = 0; i < n; ++i) {
+            emit(GEN_VERTEX_ARRAY, { arrays[i] });
+        }
+    }
+    
+    void GLAPIENTRY traceDeleteVertexArrays(GLsizei n, const GLuint *arrays){
+        for (GLsizei i = 0; i < n; ++i) {
+            emit(DELETE_VERTEX_ARRAY, { arrays[i] });
+        }
+        realDeleteVertexArrays(n, arrays);
+    }
+    
+    void GLAPIENTRY traceBindVertexArray(GLuint array){
+        emit(BIND_VERTEX_ARRAY, { array });
+        realBindVertexArray(array);
+    }
+    
+    void GLAPIENTRY traceVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer){
+        emit(VERTEX_ATTRIB_POINTER, { index, size, type, normalized, stride, offsetOf(pointer) });
+        realVertexAttribPointer(index, size, type, normalized, stride, pointer);
+    }
+    
+    void GLAPIENTRY traceVertexAttribIPointer(GLuint index, GLint size, GLenum type, GLsizei stride, const void *pointer){
+        emit(VERTEX_ATTRIB_IPOINTER, { index, size, type, stride, offsetOf(pointer) });
+        realVertexAttribIPointer(index, size, type, stride, pointer);
+    }
+    
+    void GLAPIENTRY traceEnableVertexAttribArray(GLuint index){
+        emit(ENABLE_VERTEX_ATTRIB_ARRAY, { index });
+        realEnableVertexAttribArray(index);
+    }
+    
+    void GLAPIENTRY traceDisableVertexAttribArray(GLuint index){
+        emit(DISABLE_VERTEX_ATTRIB_ARRAY, { index });
+        realDisableVertexAttribArray(index);
+    }
+    
+    GLuint GLAPIENTRY traceCreateShader(GLenum type){
+        const GLuint shader(realCreateShader(type));
+        emit(CREATE_SHADER, { type, shader });
+        return shader;
+    }
+    
+    // 分かれたソースは一つにつないで記録する
+    void GLAPIENTRY traceShaderSource(GLuint shader, GLsizei count, const GLchar *const *string, const GLint *length){
+        std::string source;
+        for (GLsizei i = 0; i < count; ++i) {
+            if (length != NULL && length[i] >= 0) {
+                source.append(string[i], length[i]);
+            } else {
+                source.append(string[i]);
+            }
+        }
+        emit(SHADER_SOURCE, { shader }, blob(source.data(), source.size()));
+        realShaderSource(shader, count, string, length);
+    }
+    
+    void GLAPIENTRY traceCompileShader(GLuint shader){
+        emit(COMPILE_SHADER, { shader });
+        realCompileShader(shader);
+    }
+    
+    void GLAPIENTRY traceAttachShader(GLuint program, GLuint shader){
+        emit(ATTACH_SHADER, { program, shader });
+        realAttachShader(program, shader);
+    }
+    
+    void GLAPIENTRY traceDeleteShader(GLuint shader){
+        emit(DELETE_SHADER, { shader });
+        realDeleteShader(shader);
+    }
+    
+    GLuint GLAPIENTRY traceCreateProgram(){
+        const GLuint program(realCreateProgram());
+        emit(CREATE_PROGRAM, { program });
+        return program;
+    }
+    
+    void GLAPIENTRY traceBindAttribLocation(GLuint program, GLuint index, const GLchar *name){
+        emit(BIND_ATTRIB_LOCATION, { program, index }, blob(name, std::strlen(name) + 1));
+        realBindAttribLocation(program, index, name);
+    }
+    
+    void GLAPIENTRY traceBindFragDataLocation(GLuint program, GLuint color, const GLchar *name){
+        emit(BIND_FRAG_DATA_LOCATION, { program, color }, blob(name, std::strlen(name) + 1));
+        realBindFragDataLocation(program, color, name);
+    }
+    
+    // 名前は '\0' で区切ってつなぐ
+    void GLAPIENTRY traceTransformFeedbackVaryings(GLuint program, GLsizei count, const GLchar *const *varyings, GLenum bufferMode){
+        std::string names;
+        for (GLsizei i = 0; i < count; ++i) {
+            names.append(varyings[i]);
+            names.push_back('\0');
+        }
+        emit(TRANSFORM_FEEDBACK_VARYINGS, { program, count, bufferMode }, blob(names.data(), names.size()));
+        realTransformFeedbackVaryings(program, count, varyings, bufferMode);
+    }
+    
+    void GLAPIENTRY traceLinkProgram(GLuint program){
+        emit(LINK_PROGRAM, { program });
+        realLinkProgram(program);
+    }
+    
+    void GLAPIENTRY traceDeleteProgram(GLuint program){
+        emit(DELETE_PROGRAM, { program });
+        realDeleteProgram(program);
+    }
+    
+    void GLAPIENTRY traceUseProgram(GLuint program){
+        emit(USE_PROGRAM, { program });
+        realUseProgram(program);
+    }
+    
+    // 場所はドライバによって変わるので, 呼び直すときに同じ名前で問い合わせて置き換える
+    GLint GLAPIENTRY traceGetUniformLocation(GLuint program, const GLchar *name){
+        const GLint location(realGetUniformLocation(program, name));
+        emit(GET_UNIFORM_LOCATION, { program, location }, blob(name, std::strlen(name) + 1));
+        return location;
+    }
+    
+    // ブロックの番号はドライバによって変わるので, 呼び直すときに名前で問い合わせられるように名前も記録する
+    void GLAPIENTRY traceUniformBlockBinding(GLuint program, GLuint index, GLuint binding){
+        GLint length(0);
+        glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_NAME_LENGTH, &length);
+        std::vector<GLchar> name(std::max(length, 1), '\0');
+        glGetActiveUniformBlockName(program, index, static_cast<GLsizei>(name.size()), NULL, name.data());
+        
+        emit(UNIFORM_BLOCK_BINDING, { program, index, binding }, blob(name.data(), std::strlen(name.data()) + 1));
+        realUniformBlockBinding(program, index, binding);
+    }
+    
+    void GLAPIENTRY traceUniform1fv(GLint location, GLsizei count, const GLfloat *value){
+        emit(UNIFORM_1FV, { location, count }, blob(value, count * sizeof(GLfloat)));
+        realUniform1fv(location, count, value);
+    }
+    
+    void GLAPIENTRY traceUniform1iv(GLint location, GLsizei count, const GLint *value){
+        emit(UNIFORM_1IV, { location, count }, blob(value, count * sizeof(GLint)));
+        realUniform1iv(location, count, value);
+    }
+    
+    void GLAPIENTRY traceUniform2fv(GLint location, GLsizei count, const GLfloat *value){
+        emit(UNIFORM_2FV, { location, count }, blob(value, count * 2 * sizeof(GLfloat)));
+        realUniform2fv(location, count, value);
+    }
+    
+    void GLAPIENTRY traceUniform3fv(GLint location, GLsizei count, const GLfloat *value){
+        emit(UNIFORM_3FV, { location, count }, blob(value, count * 3 * sizeof(GLfloat)));
+        realUniform3fv(location, count, value);
+    }
+    
+    void GLAPIENTRY traceUniform4fv(GLint location, GLsizei count, const GLfloat *value){
+        emit(UNIFORM_4FV, { location, count }, blob(value, count * 4 * sizeof(GLfloat)));
+        realUniform4fv(location, count, value);
+    }
+    
+    void GLAPIENTRY traceUniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value){
+        emit(UNIFORM_MATRIX_3FV, { location, count, transpose }, blob(value, count * 9 * sizeof(GLfloat)));
+        realUniformMatrix3fv(location, count, transpose, value);
+    }
+    
+    void GLAPIENTRY traceUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value){
+        emit(UNIFORM_MATRIX_4FV, { location, count, transpose }, blob(value, count * 16 * sizeof(GLfloat)));
+        realUniformMatrix4fv(location, count, transpose, value);
+    }
+    
+    void GLAPIENTRY traceBeginTransformFeedback(GLenum primitiveMode){
+        emit(BEGIN_TRANSFORM_FEEDBACK, { primitiveMode });
+        realBeginTransformFeedback(primitiveMode);
+    }
+    
+    void GLAPIENTRY traceEndTransformFeedback(){
+        emit(END_TRANSFORM_FEEDBACK, {});
+        realEndTransformFeedback();
+    }
+
+// GLEW が呼び出しに使うポインタ __glewXxx を trace に差し替え, 元を real に残す
+#define GLTRACE_HOOK(name) (real##name = __glew##name, __glew##name = trace##name)
+#define GLTRACE_UNHOOK(name) (__glew##name = real##name)
+#define GLTRACE_FUNCTIONS(apply) \
+    apply(GenBuffers); apply(DeleteBuffers); apply(BindBuffer); apply(BufferData); apply(BufferSubData); \
+    apply(MapBufferRange); apply(UnmapBuffer); apply(BindBufferBase); apply(BindBufferRange); \
+    apply(GenVertexArrays); apply(DeleteVertexArrays); apply(BindVertexArray); \
+    apply(VertexAttribPointer); apply(VertexAttribIPointer); apply(EnableVertexAttribArray); apply(DisableVertexAttribArray); \
+    apply(CreateShader); apply(ShaderSource); apply(CompileShader); apply(AttachShader); apply(DeleteShader); \
+    apply(CreateProgram); apply(BindAttribLocation); apply(BindFragDataLocation); apply(TransformFeedbackVaryings); \
+    apply(LinkProgram); apply(DeleteProgram); apply(UseProgram); apply(GetUniformLocation); apply(UniformBlockBinding); \
+    apply(Uniform1fv); apply(Uniform1iv); apply(Uniform2fv); apply(Uniform3fv); apply(Uniform4fv); \
+    apply(UniformMatrix3fv); apply(UniformMatrix4fv); apply(BeginTransformFeedback); apply(EndTransformFeedback)
+}
+
+bool startTrace(const char *name){
+    if (trace != NULL) {
+        return false;
+    }
+    
+    trace = std::fopen(name, "wb");
+    if (trace == NULL) {
+        logMessage(LOG_ERROR, LOG_RESOURCE, "cant create trace file: {}", name);
+        return false;
+    }
+    std::setvbuf(trace, NULL, _IOFBF, 1 << 20);
+    
+    written = 0;
+    callCount = blobBytes = duplicateBytes = 0;
+    blobs.clear();
+    mappings.clear();
+    
+    write(magic, sizeof magic);
+    write(&version, sizeof version);
+    
+    GLTRACE_FUNCTIONS(GLTRACE_HOOK);
+    
+    // 記録を始める前に決めたビューポートも呼び直せるようにする
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    emit(VIEWPORT, { viewport[0], viewport[1], viewport[2], viewport[3] });
+    
+    logMessage(LOG_INFO, LOG_GL, "tracing GL calls to {}", name);
+    return true;
+}
+
+void stopTrace(){
+    if (trace == NULL) {
+        return;
+    }
+    
+    GLTRACE_FUNCTIONS(GLTRACE_UNHOOK);
+    
+    std::fclose(trace);
+    trace = NULL;
+    
+    logMessage(LOG_INFO, LOG_GL, "trace: {} calls, {} bytes, {} bytes of payload ({} bytes deduplicated)",
+               callCount, written, blobBytes, duplicateBytes);
+}
+
+void traceFrame(){
+    if (trace != NULL) {
+        emit(FRAME, {});
+    }
+}
+
+void tracedDrawArrays(GLenum mode, GLint first, GLsizei count){
+    if (trace != NULL) emit(DRAW_ARRAYS, { mode, first, count });
+    glDrawArrays(mode, first, count);
+}
+
+void tracedDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices){
+    if (trace != NULL) emit(DRAW_ELEMENTS, { mode, count, type, offsetOf(indices) });
+    glDrawElements(mode, count, type, indices);
+}
+
+void tracedClear(GLbitfield mask){
+    if (trace != NULL) emit(CLEAR, { mask });
+    glClear(mask);
+}
+
+void tracedViewport(GLint x, GLint y, GLsizei width, GLsizei height){
+    if (trace != NULL) emit(VIEWPORT, { x, y, width, height });
+    glViewport(x, y, width, height);
+}
+
+void tracedEnable(GLenum cap){
+    if (trace != NULL) emit(ENABLE, { cap });
+    glEnable(cap);
+}
+
+void tracedDisable(GLenum cap){
+    if (trace != NULL) emit(DISABLE, { cap });
+    glDisable(cap);
+}
+
+void tracedDepthMask(GLboolean flag){
+    if (trace != NULL) emit(DEPTH_MASK, { flag });
+    glDepthMask(flag);
+}
+
+void tracedBlendFunc(GLenum sfactor, GLenum dfactor){
+    if (trace != NULL) emit(BLEND_FUNC, { sfactor, dfactor });
+    glBlendFunc(sfactor, dfactor);
+}
+
+void tracedCullFace(GLenum mode){
+    if (trace != NULL) emit(CULL_FACE, { mode });
+    glCullFace(mode);
+}
+
+void tracedFrontFace(GLenum mode){
+    if (trace != NULL) emit(FRONT_FACE, { mode });
+    glFrontFace(mode);
+}
+
+void tracedDepthFunc(GLenum func){
+    if (trace != NULL) emit(DEPTH_FUNC, { func });
+    glDepthFunc(func);
+}
+
+void tracedClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha){
+    if (trace != NULL) emit(CLEAR_COLOR, { bitsOf(red), bitsOf(green), bitsOf(blue), bitsOf(alpha) });
+    glClearColor(red, green, blue, alpha);
+}
+
+void tracedClearDepth(GLdouble depth){
+    if (trace != NULL) {
+        int64_t bits;
+        std::memcpy(&bits, &depth, 8);
+        emit(CLEAR_DEPTH, { bits });
+    }
+    glClearDepth(depth);
+}
+
+namespace {
+    class Reader{
+        const unsigned char *p;
+        const unsigned char *const end;
+    
+    public:
+        Reader(const unsigned char *begin, const unsigned char *end) : p(begin), end(end){
+        }
+        
+        bool done() const{
+            return p >= end;
+        }
+        
+        const unsigned char *position() const{
+            return p;
+        }
+        
+        bool byte(unsigned char &b){
+            if (p >= end) return false;
+            b = *p++;
+            return true;
+        }
+        
+        bool varint(uint64_t &v){
+            v = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                if (p >= end) return false;
+                const unsigned char b(*p++);
+                v |= static_cast<uint64_t>(b & 0x7f) << shift;
+                if ((b & 0x80) == 0) return true;
+            }
+            return false;
+        }
+        
+        bool bytes(void *out, size_t n){
+            if (static_cast<size_t>(end - p) < n) return false;
+            std::memcpy(out, p, n);
+            p += n;
+            return true;
+        }
+        
+        bool skip(size_t n){
+            if (static_cast<size_t>(end - p) < n) return false;
+            p += n;
+            return true;
+        }
+    };
+    
+    struct Blob{
+        const unsigned char *data;
+        size_t size;
+    };
+    
+    struct Stat{
+        unsigned long count;
+        double total, max;
+    };
+    
+    // 記録した名前から作り直した名前を引く. 名前は小さな整数なので配列で引く
+    GLuint &lookup(std::vector<GLuint> &table, int64_t name){
+        const size_t n(static_cast<size_t>(name));
+        if (n >= table.size()) {
+            table.resize(n + 1, 0);
+        }
+        return table[n];
+    }
+    
+    const void *pointerOf(int64_t offset){
+        return reinterpret_cast<const void *>(static_cast<uintptr_t>(offset));
+    }
+}
+
+bool replayTrace(const char *name){
+    std::ifstream file(name, std::ios::binary);
+    if (file.fail()) {
+        logMessage(LOG_ERROR, LOG_RESOURCE, "cant open trace file: {}", name);
+        return false;
+    }
+    
+    file.seekg(0L, std::ios::end);
+    const size_t length(static_cast<size_t>(file.tellg()));
+    file.seekg(0L, std::ios::beg);
+    
+    // 中身を 8 バイト境界から読めるように uint64_t の配列に読む
+    std::vector<uint64_t> storage((length + 7) / 8);
+    unsigned char *const data(reinterpret_cast<unsigned char *>(storage.data()));
+    file.read(reinterpret_cast<char *>(data), length);
+    if (file.fail() || length < 8 || std::memcmp(data, magic, sizeof magic) != 0) {
+        logMessage(LOG_ERROR, LOG_RESOURCE, "not a GL trace: {}", name);
+        return false;
+    }
+    
+    uint32_t fileVersion;
+    std::memcpy(&fileVersion, data + 4, 4);
+    if (fileVersion != version) {
+        logMessage(LOG_ERROR, LOG_RESOURCE, "unsupported GL trace version {}: {}", fileVersion, name);
+        return false;
+    }
+    
+    std::unordered_map<uint64_t, Blob> payloads;
+    std::vector<GLuint> buffers, arrays, shaders, programs;
+    
+    // (記録したプログラム, 記録した場所) から問い合わせ直した場所を引く
+    std::unordered_map<uint64_t, GLint> locations;
+    int64_t program(0);
+    const auto location = [&](int64_t recorded) -> GLint{
+        const auto l(locations.find(static_cast<uint64_t>(program) << 32 | static_cast<uint32_t>(recorded)));
+        return l == locations.end() ? static_cast<GLint>(recorded) : l->second;
+    };
+    
+    Stat stats[OP_COUNT] = {};
+    std::vector<double> frames;
+    
+    // できるだけ速く流すので垂直同期を待たない
+    glfwSwapInterval(0);
+    
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point frameStart(Clock::now());
+    
+    Reader in(data + 8, data + length);
+    while (!in.done()) {
+        unsigned char op;
+        in.byte(op);
+        if (op >= OP_COUNT) {
+            logMessage(LOG_ERROR, LOG_RESOURCE, "broken GL trace at byte {}: {}", in.position() - data, name);
+            return false;
+        }
+        
+        if (op == BLOB) {
+            uint64_t size, hash;
+            unsigned char padding;
+            if (!in.varint(size) || !in.bytes(&hash, 8) || !in.byte(padding) || !in.skip(padding)) {
+                break;
+            }
+            const Blob b = { in.position(), static_cast<size_t>(size) };
+            if (!in.skip(b.size)) {
+                break;
+            }
+            payloads[hash] = b;
+            continue;
+        }
+        
+        int64_t a[6] = {};
+        bool ok(true);
+        for (int i = 0; i < calls[op].argc; ++i) {
+            uint64_t z(0);
+            if (!in.varint(z)) {
+                ok = false;
+                break;
+            }
+            a[i] = unzigzag(z);
+        }
+        
+        Blob payload = { NULL, 0 };
+        if (calls[op].blob) {
+            uint64_t hash;
+            ok = ok && in.bytes(&hash, 8);
+            if (ok && hash != 0) {
+                const auto b(payloads.find(hash));
+                if (b == payloads.end()) {
+                    logMessage(LOG_ERROR, LOG_RESOURCE, "GL trace refers to a missing payload: {}", name);
+                    return false;
+                }
+                payload = b->second;
+            }
+        }
+        if (!ok) {
+            break;
+        }
+        
+        // 描き終わるまで待ってフレームの時間を測る
+        if (op == FRAME) {
+            glFinish();
+            glfwSwapBuffers(glfwGetCurrentContext());
+            const Clock::time_point now(Clock::now());
+            frames.push_back(std::chrono::duration<double, std::milli>(now - frameStart).count());
+            frameStart = now;
+            continue;
+        }
+        
+        const GLfloat *const f(reinterpret_cast<const GLfloat *>(payload.data));
+        const Clock::time_point start(Clock::now());
+        
+        switch (op) {
+            case GEN_BUFFER: glGenBuffers(1, &lookup(buffers, a[0])); break;
+            case DELETE_BUFFER: glDeleteBuffers(1, &lookup(buffers, a[0])); lookup(buffers, a[0]) = 0; break;
+            case BIND_BUFFER: glBindBuffer(a[0], lookup(buffers, a[1])); break;
+            case BUFFER_DATA: glBufferData(a[0], a[1], payload.data, a[2]); break;
+            case BUFFER_SUB_DATA: glBufferSubData(a[0], a[1], a[2], payload.data); break;
+            case MAP_WRITE:
+                if (void *const p = glMapBufferRange(a[0], a[1], a[2], a[3])) {
+                    std::memcpy(p, payload.data, std::min(payload.size, static_cast<size_t>(a[2])));
+                    glUnmapBuffer(a[0]);
+                }
+                break;
+            case BIND_BUFFER_BASE: glBindBufferBase(a[0], a[1], lookup(buffers, a[2])); break;
+            case BIND_BUFFER_RANGE: glBindBufferRange(a[0], a[1], lookup(buffers, a[2]), a[3], a[4]); break;
+            case GEN_VERTEX_ARRAY: glGenVertexArrays(1, &lookup(arrays, a[0])); break;
+            case DELETE_VERTEX_ARRAY: glDeleteVertexArrays(1, &lookup(arrays, a[0])); lookup(arrays, a[0]) = 0; break;
+            case BIND_VERTEX_ARRAY: glBindVertexArray(lookup(arrays, a[0])); break;
+            case VERTEX_ATTRIB_POINTER: glVertexAttribPointer(a[0], a[1], a[2], a[3], a[4], pointerOf(a[5])); break;
+            case VERTEX_ATTRIB_IPOINTER: glVertexAttribIPointer(a[0], a[1], a[2], a[3], pointerOf(a[4])); break;
+            case ENABLE_VERTEX_ATTRIB_ARRAY: glEnableVertexAttribArray(a[0]); break;
+            case DISABLE_VERTEX_ATTRIB_ARRAY: glDisableVertexAttribArray(a[0]); break;
+            case CREATE_SHADER: lookup(shaders, a[1]) = glCreateShader(a[0]); break;
+            case SHADER_SOURCE:{
+                const GLchar *const source(reinterpret_cast<const GLchar *>(payload.data));
+                const GLint size(static_cast<GLint>(payload.size));
+                glShaderSource(lookup(shaders, a[0]), 1, &source, &size);
+                break;
+            }
+            case COMPILE_SHADER: glCompileShader(lookup(shaders, a[0])); break;
+            case ATTACH_SHADER: glAttachShader(lookup(programs, a[0]), lookup(shaders, a[1])); break;
+            case DELETE_SHADER: glDeleteShader(lookup(shaders, a[0])); lookup(shaders, a[0]) = 0; break;
+            case CREATE_PROGRAM: lookup(programs, a[0]) = glCreateProgram(); break;
+            case BIND_ATTRIB_LOCATION: glBindAttribLocation(lookup(programs, a[0]), a[1], reinterpret_cast<const GLchar *>(payload.data)); break;
+            case BIND_FRAG_DATA_LOCATION: glBindFragDataLocation(lookup(programs, a[0]), a[1], reinterpret_cast<const GLchar *>(payload.data)); break;
+            case TRANSFORM_FEEDBACK_VARYINGS:{
+                std::vector<const GLchar *> varyings;
+                for (size_t i = 0; i < payload.size; i += std::strlen(reinterpret_cast<const char *>(payload.data + i)) + 1) {
+                    varyings.push_back(reinterpret_cast<const GLchar *>(payload.data + i));
+                }
+                glTransformFeedbackVaryings(lookup(programs, a[0]), static_cast<GLsizei>(varyings.size()), varyings.data(), a[2]);
+                break;
+            }
+            case LINK_PROGRAM: glLinkProgram(lookup(programs, a[0])); break;
+            case DELETE_PROGRAM: glDeleteProgram(lookup(programs, a[0])); lookup(programs, a[0]) = 0; break;
+            case USE_PROGRAM: program = a[0]; glUseProgram(lookup(programs, a[0])); break;
+            case GET_UNIFORM_LOCATION:
+                locations[static_cast<uint64_t>(a[0]) << 32 | static_cast<uint32_t>(a[1])]
+                    = glGetUniformLocation(lookup(programs, a[0]), reinterpret_cast<const GLchar *>(payload.data));
+                break;
+            // ブロックの番号は名前で問い合わせ直す. 名前のない記録だけ記録した番号を使う
+            case UNIFORM_BLOCK_BINDING:{
+                const GLuint p(lookup(programs, a[0]));
+                const GLuint index(payload.data != NULL ? glGetUniformBlockIndex(p, reinterpret_cast<const GLchar *>(payload.data)) : a[1]);
+                if (index != GL_INVALID_INDEX) {
+                    glUniformBlockBinding(p, index, a[2]);
+                }
+                break;
+            }
+            case UNIFORM_1FV: glUniform1fv(location(a[0]), a[1], f); break;
+            case UNIFORM_1IV: glUniform1iv(location(a[0]), a[1], reinterpret_cast<const GLint *>(payload.data)); break;
+            case UNIFORM_2FV: glUniform2fv(location(a[0]), a[1], f); break;
+            case UNIFORM_3FV: glUniform3fv(location(a[0]), a[1], f); break;
+            case UNIFORM_4FV: glUniform4fv(location(a[0]), a[1], f); break;
+            case UNIFORM_MATRIX_3FV: glUniformMatrix3fv(location(a[0]), a[1], a[2], f); break;
+            case UNIFORM_MATRIX_4FV: glUniformMatrix4fv(location(a[0]), a[1], a[2], f); break;
+            case BEGIN_TRANSFORM_FEEDBACK: glBeginTransformFeedback(a[0]); break;
+            case END_TRANSFORM_FEEDBACK: glEndTransformFeedback(); break;
+            case DRAW_ARRAYS: glDrawArrays(a[0], a[1], a[2]); break;
+            case DRAW_ELEMENTS: glDrawElements(a[0], a[1], a[2], pointerOf(a[3])); break;
+            case CLEAR: glClear(a[0]); break;
+            case VIEWPORT: glViewport(a[0], a[1], a[2], a[3]); break;
+            case ENABLE: glEnable(a[0]); break;
+            case DISABLE: glDisable(a[0]); break;
+            case DEPTH_MASK: glDepthMask(a[0]); break;
+            case BLEND_FUNC: glBlendFunc(a[0], a[1]); break;
+            case CULL_FACE: glCullFace(a[0]); break;
+            case FRONT_FACE: glFrontFace(a[0]); break;
+            case DEPTH_FUNC: glDepthFunc(a[0]); break;
+            case CLEAR_COLOR: glClearColor(floatOf(a[0]), floatOf(a[1]), floatOf(a[2]), floatOf(a[3])); break;
+            case CLEAR_DEPTH:{
+                GLdouble depth;
+                std::memcpy(&depth, &a[0], 8);
+                glClearDepth(depth);
+                break;
+            }
+        }
+        
+        const double us(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+        Stat &s(stats[op]);
+        ++s.count;
+        s.total += us;
+        s.max = std::max(s.max, us);
+    }
+    
+    if (!in.done()) {
+        logMessage(LOG_WARNING, LOG_RESOURCE, "GL trace is truncated: {}", name);
+    }
+    glFinish();
+    
+    // 呼び出しの種類ごとの CPU 側の時間を合計の多い順に並べる
+    std::vector<int> order;
+    for (int op = 0; op < OP_COUNT; ++op) {
+        if (stats[op].count > 0) order.push_back(op);
+    }
+    std::sort(order.begin(), order.end(), [&](int x, int y){ return stats[x].total > stats[y].total; });
+    
+    std::printf("%-28s %10s %12s %10s %10s\n", "call", "count", "total ms", "avg us", "max us");
+    for (const int op : order) {
+        const Stat &s(stats[op]);
+        std::printf("%-28s %10lu %12.3f %10.3f %10.3f\n", calls[op].name, s.count, s.total * 1.0e-3, s.total / s.count, s.max);
+    }
+    
+    if (!frames.empty()) {
+        std::vector<double> sorted(frames);
+        std::sort(sorted.begin(), sorted.end());
+        double total(0.0);
+        for (const double t : frames) total += t;
+        
+        std::printf("frames %zu: avg %.3f ms, min %.3f ms, median %.3f ms, max %.3f ms\n", frames.size(),
+                    total / frames.size(), sorted.front(), sorted[sorted.size() / 2], sorted.back());
+    }
+    
+    return true;
+}
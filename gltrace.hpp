@@ -0,0 +1,51 @@
+#ifndef gltrace_hpp
+#define gltrace_hpp
+
+#include <GL/glew.h>
+
+// GL の呼び出しをファイルに記録する. バッファの中身やシェーダのソースはハッシュで重複を除いて一度だけ書く
+// GLEW が関数ポインタで呼ぶものはポインタを差し替えて, GL 1.1 の関数は下のマクロで横取りする
+// glewInit() の後, 記録したい資源を作る前に呼ぶ
+bool startTrace(const char *name);
+void stopTrace();
+
+// フレームの区切りを記録する (swapBuffers() から呼ぶ)
+void traceFrame();
+
+// 記録を最初から順にできるだけ速く呼び直し, 呼び出しの種類ごとの時間とフレームの時間を出力する
+// 記録したときと同じ版の GL のコンテキストを作ってから呼ぶ
+bool replayTrace(const char *name);
+
+void tracedDrawArrays(GLenum mode, GLint first, GLsizei count);
+void tracedDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices);
+void tracedClear(GLbitfield mask);
+void tracedViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+void tracedEnable(GLenum cap);
+void tracedDisable(GLenum cap);
+void tracedDepthMask(GLboolean flag);
+void tracedBlendFunc(GLenum sfactor, GLenum dfactor);
+void tracedCullFace(GLenum mode);
+void tracedFrontFace(GLenum mode);
+void tracedDepthFunc(GLenum func);
+void tracedClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+void tracedClearDepth(GLdouble depth);
+
+// GL 1.1 の関数は GLEW を通らずに直接リンクされるので, このヘッダを読んだところから呼び出しを置き換える
+// 記録していなければそのまま元の関数を呼ぶ
+#if !defined(GLTRACE_NO_REDIRECT)
+#define glDrawArrays(mode, first, count) tracedDrawArrays(mode, first, count)
+#define glDrawElements(mode, count, type, indices) tracedDrawElements(mode, count, type, indices)
+#define glClear(mask) tracedClear(mask)
+#define glViewport(x, y, width, height) tracedViewport(x, y, width, height)
+#define glEnable(cap) tracedEnable(cap)
+#define glDisable(cap) tracedDisable(cap)
+#define glDepthMask(flag) tracedDepthMask(flag)
+#define glBlendFunc(sfactor, dfactor) tracedBlendFunc(sfactor, dfactor)
+#define glCullFace(mode) tracedCullFace(mode)
+#define glFrontFace(mode) tracedFrontFace(mode)
+#define glDepthFunc(func) tracedDepthFunc(func)
+#define glClearColor(red, green, blue, alpha) tracedClearColor(red, green, blue, alpha)
+#define glClearDepth(depth) tracedClearDepth(depth)
+#endif
+
+#endif /* gltrace_hpp */
@@ -0,0 +1,149 @@
+#include "image.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace {
+    uint32_t crcTable[256];
+    
+    // CRC-32 の表は最初に使うときに作る
+    bool makeCrcTable(){
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c(n);
+            for (int k = 0; k < 8; ++k) {
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            crcTable[n] = c;
+        }
+        return true;
+    }
+    
+    uint32_t crc32(uint32_t crc, const unsigned char *p, size_t n){
+        static const bool initialized(makeCrcTable());
+        (void)initialized;
+        
+        crc = ~crc;
+        for (size_t i = 0; i < n; ++i) {
+            crc = crcTable[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+    
+    void putBig32(std::vector<unsigned char> &out, uint32_t v){
+        out.push_back(static_cast<unsigned char>(v >> 24));
+        out.push_back(static_cast<unsigned char>(v >> 16));
+        out.push_back(static_cast<unsigned char>(v >> 8));
+        out.push_back(static_cast<unsigned char>(v));
+    }
+    
+    // 長さ, 種類, 中身, CRC の順に一つのチャンクを書く
+    void putChunk(std::vector<unsigned char> &out, const char *type, const std::vector<unsigned char> &data){
+        putBig32(out, static_cast<uint32_t>(data.size()));
+        const size_t start(out.size());
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        putBig32(out, crc32(0, &out[start], out.size() - start));
+    }
+}
+
+bool writePNG(const char *name, const unsigned char *rgba, int width, int height, bool flip){
+    // 各行の先頭にフィルタの種類 0 を置いた RGB の並び
+    const size_t row(1 + static_cast<size_t>(width) * 3);
+    std::vector<unsigned char> raw(row * height);
+    for (int y = 0; y < height; ++y) {
+        const unsigned char *src(rgba + static_cast<size_t>(flip ? height - 1 - y : y) * width * 4);
+        unsigned char *dst(&raw[row * y]);
+        *dst++ = 0;
+        for (int x = 0; x < width; ++x, src += 4) {
+            *dst++ = src[0];
+            *dst++ = src[1];
+            *dst++ = src[2];
+        }
+    }
+    
+    // zlib の見出し, 最大 65535 バイトの無圧縮ブロックの並び, Adler-32
+    std::vector<unsigned char> idat;
+    idat.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    idat.push_back(0x78);
+    idat.push_back(0x01);
+    
+    uint32_t a(1), b(0);
+    for (size_t i = 0; i < raw.size() || i == 0;) {
+        const size_t n(std::min<size_t>(65535, raw.size() - i));
+        const bool last(i + n == raw.size());
+        idat.push_back(last ? 1 : 0);
+        idat.push_back(static_cast<unsigned char>(n));
+        idat.push_back(static_cast<unsigned char>(n >> 8));
+        idat.push_back(static_cast<unsigned char>(~n));
+        idat.push_back(static_cast<unsigned char>(~n >> 8));
+        idat.insert(idat.end(), raw.begin() + i, raw.begin() + i + n);
+        
+        for (size_t j = i; j < i + n; ++j) {
+            a = (a + raw[j]) % 65521;
+            b = (b + a) % 65521;
+        }
+        
+        i += n;
+        if (last) break;
+    }
+    putBig32(idat, b << 16 | a);
+    
+    std::vector<unsigned char> ihdr;
+    putBig32(ihdr, static_cast<uint32_t>(width));
+    putBig32(ihdr, static_cast<uint32_t>(height));
+    const unsigned char format[] = { 8, 2, 0, 0, 0 };  // 8 ビットの RGB, 飛び越しなし
+    ihdr.insert(ihdr.end(), format, format + sizeof format);
+    
+    static const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    std::vector<unsigned char> png(signature, signature + sizeof signature);
+    png.reserve(idat.size() + 64);
+    putChunk(png, "IHDR", ihdr);
+    putChunk(png, "IDAT", idat);
+    putChunk(png, "IEND", std::vector<unsigned char>());
+    
+    FILE *const file(std::fopen(name, "wb"));
+    if (file == NULL) {
+        logMessage(LOG_ERROR, LOG_RESOURCE, "cant create image file: {}", name);
+        return false;
+    }
+    
+    const bool ok(std::fwrite(png.data(), 1, png.size(), file) == png.size());
+    if (std::fclose(file) != 0 || !ok) {
+        logMessage(LOG_ERROR, LOG_RESOURCE, "could not write image file: {}", name);
+        return false;
+    }
+    return true;
+}
+
+void convertI420(const unsigned char *rgba, int width, int height, unsigned char *yuv, bool flip, size_t stride){
+    if (stride == 0) {
+        stride = static_cast<size_t>(width) * 4;
+    }
+    
+    unsigned char *const py(yuv);
+    unsigned char *const pu(py + width * height);
+    unsigned char *const pv(pu + width * height / 4);
+    
+    for (int y = 0; y < height; y += 2) {
+        const unsigned char *const r0(rgba + static_cast<size_t>(flip ? height - 1 - y : y) * stride);
+        const unsigned char *const r1(rgba + static_cast<size_t>(flip ? height - 2 - y : y + 1) * stride);
+        
+        for (int x = 0; x < width; x += 2) {
+            int su(0), sv(0);
+            
+            // 2x2 の画素の輝度を求め, 色差は平均をとる
+            const unsigned char *const p[4] = { r0 + x * 4, r0 + x * 4 + 4, r1 + x * 4, r1 + x * 4 + 4 };
+            for (int i = 0; i < 4; ++i) {
+                const int r(p[i][0]), g(p[i][1]), b(p[i][2]);
+                py[(y + i / 2) * width + x + i % 2] = static_cast<unsigned char>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+                su += (-38 * r - 74 * g + 112 * b + 128) >> 8;
+                sv += (112 * r - 94 * g - 18 * b + 128) >> 8;
+            }
+            
+            pu[y / 2 * (width / 2) + x / 2] = static_cast<unsigned char>(su / 4 + 128);
+            pv[y / 2 * (width / 2) + x / 2] = static_cast<unsigned char>(sv / 4 + 128);
+        }
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef image_hpp
+#define image_hpp
+
+#include <cstddef>
+
+// glReadPixels で読んだ RGBA の画素を書き出す. flip なら下の行から並んでいるものとして上下を返す
+
+// アルファを捨てた RGB の PNG を書く. 圧縮はせず deflate の無圧縮ブロックに入れる
+bool writePNG(const char *name, const unsigned char *rgba, int width, int height, bool flip = true);
+
+// BT.601 の YUV 4:2:0 (I420) に変換する. width と height は偶数で, yuv は width * height * 3 / 2 バイト
+// stride は rgba の 1 行のバイト数 (0 なら width * 4)
+void convertI420(const unsigned char *rgba, int width, int height, unsigned char *yuv, bool flip = true, size_t stride = 0);
+
+#endif /* image_hpp */
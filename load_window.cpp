@@ -5,7 +5,7 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
-GLuint createProgram(const char *vsrc, const char *fsrc){
+GLuint createProgram(const char *vsrc, const char *fsrc, const char *const *varyings, GLsizei varyingCount){
     const GLuint program(glCreateProgram());
     
     if (vsrc != NULL) {
@@ -35,7 +35,16 @@ GLuint createProgram(const char *vsrc, const char *fsrc){
     
     glBindAttribLocation(program, 0, "position");
     glBindAttribLocation(program, 1, "normal");
+    glBindAttribLocation(program, 2, "joints");
+    glBindAttribLocation(program, 3, "weights");
+    glBindAttribLocation(program, 1, "velocity");
     glBindFragDataLocation(program, 0, "fragment");
+    
+    // Transform Feedback で書き出す変数はリンクする前に指定する
+    if (varyings != NULL) {
+        glTransformFeedbackVaryings(program, varyingCount, varyings, GL_INTERLEAVED_ATTRIBS);
+    }
+    
     glLinkProgram(program);
     
     if (printProgramInfoLog(program)) {
@@ -53,7 +62,7 @@ bool readShaderSource(const char *name, std::vector<GLchar> &buffer){
     
     std::ifstream file(name, std::ios::binary);
     if (file.fail()) {
-        std::cerr << "error: cant open source file: " << name << std::endl;
+        logMessage(LOG_ERROR, LOG_RESOURCE, "cant open source file: {}", name);
         return false;
     }
     
@@ -67,7 +76,7 @@ bool readShaderSource(const char *name, std::vector<GLchar> &buffer){
     buffer[length] = '\0';
     
     if (file.fail()) {
-        std::cerr << "error: could not read source file: " << name << std::endl;
+        logMessage(LOG_ERROR, LOG_RESOURCE, "could not read source file: {}", name);
         return false;
     }
     
@@ -75,12 +84,13 @@ bool readShaderSource(const char *name, std::vector<GLchar> &buffer){
     return true;
 }
 
-GLuint loadProgram(const char *vert, const char *frag){
+// frag が NULL ならフラグメントシェーダを使わない (Transform Feedback 用)
+GLuint loadProgram(const char *vert, const char *frag, const char *const *varyings, GLsizei varyingCount){
     std::vector<GLchar> vsrc;
     const bool vstat(readShaderSource(vert, vsrc));
     std::vector<GLchar> fsrc;
-    const bool fstat(readShaderSource(frag, fsrc));
+    const bool fstat(frag == NULL || readShaderSource(frag, fsrc));
     
-    return vstat && fstat ? createProgram(vsrc.data(), fsrc.data()) : 0;
+    return vstat && fstat ? createProgram(vsrc.data(), frag == NULL ? NULL : fsrc.data(), varyings, varyingCount) : 0;
 }
 
@@ -5,8 +5,8 @@
 #include <vector>
 #include <GL/glew.h>
 
-GLuint createProgram(const char *vsrc, const char *fsrc);
+GLuint createProgram(const char *vsrc, const char *fsrc, const char *const *varyings = NULL, GLsizei varyingCount = 0);
 bool readShaderSource(const char *name, std::vector<GLchar> &buffer);
-GLuint loadProgram(const char *vert, const char *frag);
+GLuint loadProgram(const char *vert, const char *frag, const char *const *varyings = NULL, GLsizei varyingCount = 0);
 
 #endif /* load_window_hpp */
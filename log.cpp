@@ -1,14 +1,33 @@
 #include "log.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+// 情報ログは長いので 1 行ずつ別のメッセージにする
+static void logInfoLog(LogLevel level, const char *log){
+    for (const char *line(log); *line != '\0';) {
+        const char *end(std::strchr(line, '\n'));
+        const size_t length(end == NULL ? std::strlen(line) : static_cast<size_t>(end - line));
+        if (length > 0) {
+            logMessage(level, LOG_SHADER, "{}", std::string(line, length));
+        }
+        line += length + (end == NULL ? 0 : 1);
+    }
+}
+
 GLboolean printProgramInfoLog(GLuint program){
     GLint status;
     glGetProgramiv(program, GL_LINK_STATUS, &status);
     if (status == GL_FALSE) {
-        std::cerr << "link error " << std::endl;
+        logMessage(LOG_ERROR, LOG_SHADER, "link error");
     }
     
     GLsizei bufSize;
@@ -18,7 +37,7 @@ GLboolean printProgramInfoLog(GLuint program){
         std::vector<GLchar> infoLog(bufSize);
         GLsizei length;
         glGetProgramInfoLog(program, bufSize, &length, &infoLog[0]);
-        std::cerr << &infoLog[0] << std::endl;
+        logInfoLog(status == GL_FALSE ? LOG_ERROR : LOG_WARNING, &infoLog[0]);
     }
     
     return static_cast<GLboolean>(status);
@@ -28,7 +47,7 @@ GLboolean printShaderInfoLog(GLuint shader, const char *str){
     GLint status;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
     if (status == GL_FALSE) {
-        std::cerr << "compile error in " << str << std::endl;
+        logMessage(LOG_ERROR, LOG_SHADER, "compile error in {}", str);
     }
     
     GLsizei bufSize;
@@ -38,8 +57,384 @@ GLboolean printShaderInfoLog(GLuint shader, const char *str){
         std::vector<GLchar> infoLog(bufSize);
         GLsizei length;
         glGetShaderInfoLog(shader, bufSize, &length, &infoLog[0]);
-        std::cerr << &infoLog[0] << std::endl;
+        logInfoLog(status == GL_FALSE ? LOG_ERROR : LOG_WARNING, &infoLog[0]);
     }
     
     return static_cast<GLboolean>(status);
 }
+
+namespace {
+    // 一つのスレッドが書き, ドレインスレッドが読むバイトのリング
+    struct Ring{
+        static constexpr size_t capacity = 1 << 16;
+        
+        unsigned char data[capacity];
+        
+        // 単調に増える書き込み位置と読み出し位置
+        std::atomic<size_t> head;
+        std::atomic<size_t> tail;
+        
+        // reserve() で確保して commit() で公開する書き込み位置
+        size_t reserved;
+        
+        std::atomic<size_t> dropped;
+        
+        Ring() : head(0), tail(0), reserved(0), dropped(0){
+        }
+    };
+    
+    // 折り返しのために読み飛ばす領域の印
+    constexpr unsigned char paddingLevel = 0xff;
+    
+    size_t align8(size_t size){
+        return (size + 7) & ~static_cast<size_t>(7);
+    }
+    
+    const char *const levelName[] = { "DEBUG", "INFO", "WARN", "ERROR", "FATAL" };
+    const char *const categoryName[] = { "general", "gl", "shader", "window", "resource" };
+    
+    class Logger{
+        std::mutex mutex;
+        std::condition_variable wake, flushed;
+        std::vector<Ring *> rings;
+        
+        // flushLog() が頼んだ回数と, ドレインスレッドが済ませた回数
+        unsigned long requested, completed;
+        
+        bool stopping;
+        std::thread drain;
+        
+        // 整形した行. ドレインスレッドだけが使う
+        char line[4096];
+        
+        // line の後ろに書き足す
+        size_t append(size_t n, const char *s, size_t length){
+            const size_t m(std::min(length, sizeof line - 1 - n));
+            std::memcpy(line + n, s, m);
+            return n + m;
+        }
+        
+        size_t appendArgument(size_t n, const unsigned char *&p){
+            char buffer[32];
+            const unsigned char tag(*p++);
+            
+            if (tag == logdetail::STRING) {
+                uint32_t length;
+                std::memcpy(&length, p, 4);
+                n = append(n, reinterpret_cast<const char *>(p + 4), length);
+                p += 4 + length;
+                return n;
+            }
+            
+            int64_t i;
+            std::memcpy(&i, p, 8);
+            p += 8;
+            
+            int length(0);
+            switch (tag) {
+                case logdetail::SIGNED:
+                    length = std::snprintf(buffer, sizeof buffer, "%lld", static_cast<long long>(i));
+                    break;
+                case logdetail::UNSIGNED:
+                    length = std::snprintf(buffer, sizeof buffer, "%llu", static_cast<unsigned long long>(i));
+                    break;
+                case logdetail::REAL:{
+                    double d;
+                    std::memcpy(&d, &i, 8);
+                    length = std::snprintf(buffer, sizeof buffer, "%g", d);
+                    break;
+                }
+                case logdetail::BOOLEAN:
+                    length = std::snprintf(buffer, sizeof buffer, "%s", i != 0 ? "true" : "false");
+                    break;
+                case logdetail::POINTER:
+                    length = std::snprintf(buffer, sizeof buffer, "0x%llx", static_cast<unsigned long long>(i));
+                    break;
+            }
+            return append(n, buffer, static_cast<size_t>(std::max(length, 0)));
+        }
+        
+        // 一つのメッセージを整形して出力する
+        void write(const logdetail::Header &header, const unsigned char *p){
+            const double seconds(static_cast<double>(header.time) * 1.0e-9);
+            int length(std::snprintf(line, sizeof line, "[%11.6f] %-5s %s: ", seconds,
+                                     levelName[std::min<int>(header.level, LOG_FATAL)],
+                                     categoryName[std::min<int>(header.category, LOG_RESOURCE)]));
+            size_t n(static_cast<size_t>(std::max(length, 0)));
+            
+            int argc(header.argc);
+            for (const char *f(header.format); *f != '\0'; ++f) {
+                if (f[0] == '{' && f[1] == '}' && argc > 0) {
+                    n = appendArgument(n, p);
+                    --argc;
+                    ++f;
+                } else {
+                    n = append(n, f, 1);
+                }
+            }
+            
+            // 余った引数は後ろに並べる
+            while (argc-- > 0) {
+                n = append(n, " ", 1);
+                n = appendArgument(n, p);
+            }
+            
+            line[n++] = '\n';
+            std::fwrite(line, 1, n, stderr);
+        }
+        
+        // 先頭のメッセージの時刻が一番早いリングから順に出力する
+        bool drainOnce(){
+            bool any(false);
+            
+            for (;;) {
+                Ring *first(NULL);
+                logdetail::Header earliest = {};
+                
+                for (Ring *r : rings) {
+                    const size_t t(r->tail.load(std::memory_order_relaxed));
+                    if (t == r->head.load(std::memory_order_acquire)) {
+                        continue;
+                    }
+                    
+                    // 読み飛ばす印は大きさとレベルしか書かれておらず, 輪の末尾に Header より短い隙間しかないこともある
+                    // 大きさとレベルだけ読んで印でないと分かってから Header 全体を読む
+                    logdetail::Header h = {};
+                    const unsigned char *const p(r->data + t % Ring::capacity);
+                    std::memcpy(&h, p, sizeof(uint32_t) + 1);
+                    if (h.level == paddingLevel) {
+                        r->tail.store(t + h.size, std::memory_order_release);
+                        any = true;
+                        continue;
+                    }
+                    
+                    std::memcpy(&h, p, sizeof h);
+                    if (first == NULL || h.time < earliest.time) {
+                        first = r;
+                        earliest = h;
+                    }
+                }
+                
+                if (first == NULL) {
+                    break;
+                }
+                
+                const size_t t(first->tail.load(std::memory_order_relaxed));
+                write(earliest, first->data + t % Ring::capacity + sizeof earliest);
+                first->tail.store(t + align8(earliest.size), std::memory_order_release);
+                any = true;
+            }
+            
+            for (Ring *r : rings) {
+                if (const size_t d = r->dropped.exchange(0)) {
+                    const int length(std::snprintf(line, sizeof line, "[%11.6f] WARN  general: %zu log messages dropped\n",
+                                                   static_cast<double>(logdetail::now()) * 1.0e-9, d));
+                    std::fwrite(line, 1, static_cast<size_t>(std::max(length, 0)), stderr);
+                }
+            }
+            
+            if (any) {
+                std::fflush(stderr);
+            }
+            return any;
+        }
+        
+        void loop(){
+            std::unique_lock<std::mutex> lock(mutex);
+            
+            for (;;) {
+                const unsigned long request(requested);
+                drainOnce();
+                
+                if (completed != request) {
+                    completed = request;
+                    flushed.notify_all();
+                }
+                
+                if (stopping) {
+                    return;
+                }
+                
+                // 頼まれなければ少しずつまとめて出力する
+                wake.wait_for(lock, std::chrono::milliseconds(10), [&]{ return stopping || requested != completed; });
+            }
+        }
+        
+    public:
+        Logger() : requested(0), completed(0), stopping(false){
+            drain = std::thread(&Logger::loop, this);
+        }
+        
+        ~Logger(){
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            drain.join();
+            
+            for (Ring *r : rings) {
+                delete r;
+            }
+            rings.clear();
+        }
+        
+        Ring *attach(){
+            Ring *const r(new Ring);
+            std::lock_guard<std::mutex> lock(mutex);
+            rings.push_back(r);
+            return r;
+        }
+        
+        void flush(){
+            std::unique_lock<std::mutex> lock(mutex);
+            const unsigned long request(++requested);
+            wake.notify_all();
+            flushed.wait(lock, [&]{ return completed >= request || stopping; });
+        }
+    };
+    
+    const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+    
+    std::atomic<int> minimumLevel(LOG_INFO);
+    
+    // 終了処理でロガーを壊した後のメッセージは捨てる
+    std::atomic<bool> alive(false);
+    
+    Logger &logger(){
+        static struct Instance{
+            Logger logger;
+            Instance(){ alive = true; }
+            ~Instance(){ alive = false; }
+        } instance;
+        return instance.logger;
+    }
+    
+    thread_local Ring *ring(NULL);
+}
+
+void setLogLevel(LogLevel level){
+    minimumLevel.store(level, std::memory_order_relaxed);
+}
+
+void flushLog(){
+    if (alive) {
+        logger().flush();
+    }
+}
+
+bool logdetail::enabled(LogLevel level){
+    return level >= minimumLevel.load(std::memory_order_relaxed);
+}
+
+int64_t logdetail::now(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+unsigned char *logdetail::reserve(size_t size){
+    if (ring == NULL) {
+        Logger &l(logger());
+        if (!alive) {
+            return NULL;
+        }
+        ring = l.attach();
+    } else if (!alive.load(std::memory_order_relaxed)) {
+        return NULL;
+    }
+    
+    size = align8(size);
+    if (size > Ring::capacity / 4) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+    }
+    
+    size_t h(ring->head.load(std::memory_order_relaxed));
+    const size_t t(ring->tail.load(std::memory_order_acquire));
+    const size_t contiguous(Ring::capacity - h % Ring::capacity);
+    const size_t padding(contiguous < size ? contiguous : 0);
+    
+    if (h + padding + size - t > Ring::capacity) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+    }
+    
+    // 末尾に入らなければ残りを読み飛ばす印を置いて先頭から書く
+    if (padding > 0) {
+        Header pad = {};
+        pad.size = static_cast<uint32_t>(padding);
+        pad.level = paddingLevel;
+        std::memcpy(ring->data + h % Ring::capacity, &pad, sizeof(uint32_t) + 1);
+        h += padding;
+    }
+    
+    ring->reserved = h + size;
+    return ring->data + h % Ring::capacity;
+}
+
+void logdetail::commit(){
+    ring->head.store(ring->reserved, std::memory_order_release);
+}
+
+namespace {
+    // 同じ番号のメッセージは最初の 10 回と, その後は 1000 回に 1 回だけ出す
+    std::atomic<unsigned int> debugCounts[256];
+    
+    const char *debugSource(GLenum source){
+        switch (source) {
+            case GL_DEBUG_SOURCE_API: return "api";
+            case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+            case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+            case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+            case GL_DEBUG_SOURCE_APPLICATION: return "application";
+            default: return "other";
+        }
+    }
+    
+    const char *debugType(GLenum type){
+        switch (type) {
+            case GL_DEBUG_TYPE_ERROR: return "error";
+            case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+            case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+            case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+            case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+            default: return "other";
+        }
+    }
+    
+    LogLevel debugLevel(GLenum severity){
+        switch (severity) {
+            case GL_DEBUG_SEVERITY_HIGH: return LOG_ERROR;
+            case GL_DEBUG_SEVERITY_MEDIUM: return LOG_WARNING;
+            case GL_DEBUG_SEVERITY_LOW: return LOG_INFO;
+            default: return LOG_DEBUG;
+        }
+    }
+    
+    void APIENTRY debugCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                GLsizei length, const GLchar *message, const void *){
+        const unsigned int n(debugCounts[id % 256].fetch_add(1, std::memory_order_relaxed) + 1);
+        if (n > 10 && n % 1000 != 0) {
+            return;
+        }
+        
+        const std::string text(message, length < 0 ? std::strlen(message) : static_cast<size_t>(length));
+        if (n > 10) {
+            logMessage(debugLevel(severity), LOG_GL, "{} {} {}: {} (repeated {} times)", debugSource(source), debugType(type), id, text, n);
+        } else {
+            logMessage(debugLevel(severity), LOG_GL, "{} {} {}: {}", debugSource(source), debugType(type), id, text);
+        }
+    }
+}
+
+void installDebugOutput(){
+    if (GLEW_KHR_debug) {
+        glEnable(GL_DEBUG_OUTPUT);
+        glDebugMessageCallback(debugCallback, NULL);
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
+    } else if (GLEW_ARB_debug_output) {
+        glDebugMessageCallbackARB(debugCallback, NULL);
+        glDebugMessageControlARB(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
+    } else {
+        logMessage(LOG_INFO, LOG_GL, "no debug output extension");
+    }
+}
@@ -1,9 +1,161 @@
 #ifndef log_hpp
 #define log_hpp
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
 #include <GL/glew.h>
 
 GLboolean printProgramInfoLog(GLuint program);
 GLboolean printShaderInfoLog(GLuint shader, const char *str);
 
+enum LogLevel{ LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERROR, LOG_FATAL };
+enum LogCategory{ LOG_GENERAL, LOG_GL, LOG_SHADER, LOG_WINDOW, LOG_RESOURCE };
+
+// これより低いレベルのメッセージは引数を写す前に捨てる (最初は LOG_INFO)
+void setLogLevel(LogLevel level);
+
+// それまでに書いたメッセージがすべて出力されるまで待つ
+void flushLog();
+
+// KHR_debug か ARB_debug_output があれば GL のデバッグメッセージをロガーに流す
+void installDebugOutput();
+
+// 呼び出したスレッドのリングバッファに引数を写すだけで, 整形と出力はドレインスレッドで行う
+namespace logdetail{
+    enum Tag : unsigned char{ SIGNED, UNSIGNED, REAL, STRING, BOOLEAN, POINTER };
+    
+    // 一つの文字列引数から写す最大のバイト数
+    constexpr size_t maxString = 1024;
+    
+    struct Header{
+        uint32_t size;
+        unsigned char level;
+        unsigned char category;
+        unsigned char argc;
+        unsigned char padding;
+        const char *format;
+        int64_t time;
+    };
+    
+    bool enabled(LogLevel level);
+    
+    // 呼び出したスレッドのリングに size バイトを確保する. 一杯なら NULL を返し, 捨てた数を数える
+    unsigned char *reserve(size_t size);
+    void commit();
+    
+    int64_t now();
+    
+    template <typename T>
+    typename std::enable_if<std::is_arithmetic<T>::value || std::is_pointer<T>::value, size_t>::type
+    size(const T &){
+        return 1 + 8;
+    }
+    
+    inline size_t stringSize(size_t length){
+        return 1 + 4 + (length < maxString ? length : maxString);
+    }
+    
+    inline size_t size(const char *s){
+        return stringSize(s == NULL ? 0 : std::strlen(s));
+    }
+    
+    inline size_t size(char *s){
+        return size(static_cast<const char *>(s));
+    }
+    
+    inline size_t size(const std::string &s){
+        return stringSize(s.size());
+    }
+    
+    template <size_t N>
+    size_t size(const char (&s)[N]){
+        return size(static_cast<const char *>(s));
+    }
+    
+    inline unsigned char *put(unsigned char *p, Tag tag, const void *v, size_t n){
+        *p++ = tag;
+        std::memcpy(p, v, n);
+        return p + n;
+    }
+    
+    inline unsigned char *putString(unsigned char *p, const char *s, size_t length){
+        const uint32_t n(static_cast<uint32_t>(length < maxString ? length : maxString));
+        p = put(p, STRING, &n, 4);
+        std::memcpy(p, s, n);
+        return p + n;
+    }
+    
+    template <typename T>
+    typename std::enable_if<std::is_arithmetic<T>::value || std::is_pointer<T>::value, unsigned char *>::type
+    put(unsigned char *p, const T &v){
+        if constexpr (std::is_same<T, bool>::value) {
+            const int64_t b(v ? 1 : 0);
+            return put(p, BOOLEAN, &b, 8);
+        } else if constexpr (std::is_floating_point<T>::value) {
+            const double d(static_cast<double>(v));
+            return put(p, REAL, &d, 8);
+        } else if constexpr (std::is_pointer<T>::value) {
+            const uint64_t u(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(v)));
+            return put(p, POINTER, &u, 8);
+        } else if constexpr (std::is_signed<T>::value) {
+            const int64_t i(static_cast<int64_t>(v));
+            return put(p, SIGNED, &i, 8);
+        } else {
+            const uint64_t u(static_cast<uint64_t>(v));
+            return put(p, UNSIGNED, &u, 8);
+        }
+    }
+    
+    inline unsigned char *put(unsigned char *p, const char *s){
+        return s == NULL ? putString(p, "", 0) : putString(p, s, std::strlen(s));
+    }
+    
+    inline unsigned char *put(unsigned char *p, char *s){
+        return put(p, static_cast<const char *>(s));
+    }
+    
+    inline unsigned char *put(unsigned char *p, const std::string &s){
+        return putString(p, s.data(), s.size());
+    }
+    
+    template <size_t N>
+    unsigned char *put(unsigned char *p, const char (&s)[N]){
+        return put(p, static_cast<const char *>(s));
+    }
+}
+
+// format の {} を前から順に引数で置き換える
+// format は整形するまで残っていなければならないので文字列リテラルを渡す
+// LOG_FATAL ならメッセージが出力されるまで待ってから戻る
+template <typename... Args>
+void logMessage(LogLevel level, LogCategory category, const char *format, const Args &... args){
+    if (!logdetail::enabled(level)) {
+        return;
+    }
+    
+    const size_t size(sizeof(logdetail::Header) + (size_t(0) + ... + logdetail::size(args)));
+    
+    unsigned char *const record(logdetail::reserve(size));
+    if (record != NULL) {
+        logdetail::Header header = {
+            static_cast<uint32_t>(size), static_cast<unsigned char>(level), static_cast<unsigned char>(category),
+            static_cast<unsigned char>(sizeof...(args)), 0, format, logdetail::now()
+        };
+        std::memcpy(record, &header, sizeof header);
+        
+        unsigned char *p(record + sizeof header);
+        ((p = logdetail::put(p, args)), ...);
+        (void)p;
+        
+        logdetail::commit();
+    }
+    
+    if (level == LOG_FATAL) {
+        flushLog();
+    }
+}
+
 #endif /* log_hpp */
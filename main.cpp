@@ -1,22 +1,48 @@
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
-#include <iostream>
+#include <cstring>
 #include <vector>
 #include <memory>
 #include <unistd.h>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include "load_window.hpp"
+#include "log.hpp"
+#include "gltrace.hpp"
+#include "alloc_check.hpp"
+#include "meshcodec.hpp"
+#include "pointcloud.hpp"
 #include "class/Object.h"
 #include "class/Shape.h"
 #include "class/ShapeIndex.h"
 #include "class/SolidShapeIndex.h"
 #include "class/SolidShape.h"
 #include "class/Window.h"
+#include "class/Simulation.h"
 #include "class/Matrix.h"
 #include "class/Vector.h"
 #include "class/Material.h"
 #include "class/Uniform.h"
+#include "class/Quaternion.h"
+#include "class/Skeleton.h"
+#include "class/Animation.h"
+#include "class/SkinnedShape.h"
+#include "class/ThreadPool.h"
+#include "class/FrameArena.h"
+#include "class/Program.h"
+#include "class/PointCloud.h"
+#include "class/TriangleBVH.h"
+#include "class/Picker.h"
+#include "class/Ray.h"
+#include "class/FrameCapture.h"
+#include "class/ResourcePool.h"
+#include "class/ParticleSimulator.h"
+#include "class/ParticleSystem.h"
+
+// 法線変換行列と光源の色
+using NormalMatrix = std::array<GLfloat, 9>;
+using Color = std::array<GLfloat, 3>;
 
 static constexpr Object::Vertex rectangleVertex[] = {
     { -0.5f, -0.5f }, { 0.5f, -0.5f }, { 0.5f, 0.5f }, { -0.5f, 0.5f }
@@ -121,10 +147,15 @@ constexpr GLuint solidCubeIndex[] = {
 int main(int argc, const char * argv[]) {
     char dir[255];
     getcwd(dir,255);
-    std::cout << "Current Directory : " << dir << std::endl;
+    logMessage(LOG_INFO, LOG_GENERAL, "current directory: {}", dir);
+    
+    // 点群の八分木を作るだけならウィンドウは開かない
+    if (argc == 4 && strcmp(argv[1], "-build-octree") == 0) {
+        return buildPointCloud(argv[2], argv[3]) ? 0 : 1;
+    }
 
     if (glfwInit() == GL_FALSE) {
-        std::cerr << "Cant initialize GLFW" << std::endl;
+        logMessage(LOG_FATAL, LOG_WINDOW, "cant initialize GLFW");
         return 1;
     }
     
@@ -135,7 +166,93 @@ int main(int argc, const char * argv[]) {
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     
+    // -hidden ならウィンドウを表示せずに描く (キャプチャ用)
+    // -gldebug ならデバッグコンテキストを作って GL のメッセージをすべて受け取る
+    // -replay なら startTrace() で記録した呼び出しを見えないウィンドウで流し直すだけ
+    const char *replayPath(NULL);
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-hidden") == 0) {
+            glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+        } else if (strcmp(argv[i], "-gldebug") == 0) {
+            glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+            setLogLevel(LOG_DEBUG);
+        } else if (strcmp(argv[i], "-replay") == 0 && i + 1 < argc) {
+            glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+            replayPath = argv[++i];
+        }
+    }
+    
     Window window;
+    installDebugOutput();
+    
+    if (replayPath != NULL) {
+        return replayTrace(replayPath) ? 0 : 1;
+    }
+    
+    // "cpu" か "gpu" なら関節で曲がる円柱も描く
+    const char *skinning(NULL);
+    
+    // "gpu" か "cpu" なら particleCount 個の粒子も動かす
+    const char *particles(NULL);
+    GLsizei particleCount(0);
+    
+    // buildPointCloud() で作った点群のディレクトリ
+    const char *pointCloudDirectory(NULL);
+    
+    // true なら球を一度圧縮して, 展開しながらバッファに送る
+    bool compressed(false);
+    
+    // "png" か "yuv" なら captureFrames フレーム (0 なら終わるまで) を capturePath に書き出す
+    const char *captureFormat(NULL);
+    const char *capturePath(NULL);
+    unsigned long captureFrames(0);
+    
+    // GL の呼び出しを記録するファイル
+    const char *tracePath(NULL);
+    
+    // true なら GPU のバッファの使用量を定期的にログに出す
+    bool memoryReport(false);
+    
+    // true ならフレームの時間の平均を定期的にログに出す
+    bool timingReport(false);
+    
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-unlocked") == 0) {
+            window.setPresentMode(FramePacer::UNLOCKED);
+        } else if (strcmp(argv[i], "-adaptive") == 0) {
+            window.setPresentMode(FramePacer::ADAPTIVE);
+        } else if (strcmp(argv[i], "-lowlatency") == 0 && i + 1 < argc) {
+            window.setPresentMode(FramePacer::LOW_LATENCY, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "-fps") == 0 && i + 1 < argc) {
+            window.setFrameLimit(atof(argv[++i]));
+        } else if (strcmp(argv[i], "-skinning") == 0 && i + 1 < argc) {
+            skinning = argv[++i];
+        } else if (strcmp(argv[i], "-particles") == 0 && i + 2 < argc) {
+            particles = argv[++i];
+            particleCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-pointcloud") == 0 && i + 1 < argc) {
+            pointCloudDirectory = argv[++i];
+        } else if (strcmp(argv[i], "-compressed") == 0) {
+            compressed = true;
+        } else if (strcmp(argv[i], "-capture") == 0 && i + 3 < argc) {
+            captureFormat = argv[++i];
+            capturePath = argv[++i];
+            captureFrames = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (strcmp(argv[i], "-budget") == 0 && i + 1 < argc) {
+            ResourcePool::instance().setBudget(static_cast<size_t>(atof(argv[++i]) * 1048576.0));
+        } else if (strcmp(argv[i], "-memory") == 0) {
+            memoryReport = true;
+        } else if (strcmp(argv[i], "-stats") == 0) {
+            timingReport = true;
+        }
+    }
+    
+    // 資源を作る前から記録する
+    if (tracePath != NULL) {
+        startTrace(tracePath);
+    }
     
     glClearColor(1.0f, 1.0f, 1.0f, 0.0f);
     
@@ -147,23 +264,35 @@ int main(int argc, const char * argv[]) {
     glDepthFunc(GL_LESS);
     glEnable(GL_DEPTH_TEST);
  
-    const GLuint program(loadProgram("point.vert", "point.frag"));
+    Program program(loadProgram("point.vert", "point.frag"));
+    
+    const Program::Variable<Matrix> modelViewLoc(program.uniform<Matrix>("modelview"));
+    const Program::Variable<Matrix> projectionLoc(program.uniform<Matrix>("projection"));
+    const Program::Variable<NormalMatrix> normalMatrixLoc(program.uniform<NormalMatrix>("normalMatrix"));
+    const Program::Variable<Vector> LposLoc(program.uniform<Vector>("Lpos"));
+    const Program::Variable<Color> LambLoc(program.uniform<Color>("Lamb"));
+    const Program::Variable<Color> LdiffLoc(program.uniform<Color>("Ldiff"));
+    const Program::Variable<Color> LspecLoc(program.uniform<Color>("Lspec"));
     
-    const GLint modelViewLoc(glGetUniformLocation(program, "modelview"));
-    const GLint projectionLoc(glGetUniformLocation(program, "projection"));
-    const GLint normalMatrixLoc(glGetUniformLocation(program, "normalMatrix"));
-    const GLint LposLoc(glGetUniformLocation(program, "Lpos"));
-    const GLint LambLoc(glGetUniformLocation(program, "Lamb"));
-    const GLint LdiffLoc(glGetUniformLocation(program, "Ldiff"));
-    const GLint LspecLoc(glGetUniformLocation(program, "Lspec"));
+    program.bind<Material>("Material", 0);
     
-    const GLint materialLoc(glGetUniformBlockIndex(program, "Material"));
+    Program skinProgram(loadProgram("skin.vert", "point.frag"));
     
-    glUniformBlockBinding(program, materialLoc, 0);
+    const Program::Variable<Matrix> skinModelViewLoc(skinProgram.uniform<Matrix>("modelview"));
+    const Program::Variable<Matrix> skinProjectionLoc(skinProgram.uniform<Matrix>("projection"));
+    const Program::Variable<NormalMatrix> skinNormalMatrixLoc(skinProgram.uniform<NormalMatrix>("normalMatrix"));
+    const Program::Variable<Vector> skinLposLoc(skinProgram.uniform<Vector>("Lpos"));
+    const Program::Variable<Color> skinLambLoc(skinProgram.uniform<Color>("Lamb"));
+    const Program::Variable<Color> skinLdiffLoc(skinProgram.uniform<Color>("Ldiff"));
+    const Program::Variable<Color> skinLspecLoc(skinProgram.uniform<Color>("Lspec"));
+    
+    skinProgram.bind<Material>("Material", 0);
+    skinProgram.bind<SkinnedShape::Palette>("Palette", 1);
     
     const int slices(16), stacks(8);
     
     std::vector<Object::Vertex> solidSphereVertex;
+    solidSphereVertex.reserve((stacks + 1) * (slices + 1));
     
     for (int j = 0; j <= stacks; ++j) {
         const float t(static_cast<float>(j) / static_cast<float>(stacks));
@@ -179,6 +308,7 @@ int main(int argc, const char * argv[]) {
     }
     
     std::vector<GLuint> solidSphereIndex;
+    solidSphereIndex.reserve((stacks + 1) * (slices + 1) * 6);
     
     for (int j = 0; j <= stacks; ++j) {
         const int k((slices + 1) * j);
@@ -200,15 +330,149 @@ int main(int argc, const char * argv[]) {
     }
 
     //std::unique_ptr<const Shape> shape(new SolidShapeIndex(3, 36, solidCubeVertex, 36, solidCubeIndex));
-    std::unique_ptr<const Shape> shape(new SolidShapeIndex(3,
-       static_cast<GLsizei>(solidSphereVertex.size()), solidSphereVertex.data(),
-       static_cast<GLsizei>(solidSphereIndex.size()), solidSphereIndex.data()));
+    std::unique_ptr<const Shape> shape;
+    if (compressed) {
+        EncodedMesh mesh;
+        mesh.vertexcount = static_cast<GLsizei>(solidSphereVertex.size());
+        mesh.indexcount = static_cast<GLsizei>(solidSphereIndex.size());
+        encodeVertexBuffer(solidSphereVertex.data(), mesh.vertexcount, sizeof(Object::Vertex), mesh.vertex);
+        encodeIndexBuffer(solidSphereIndex.data(), mesh.indexcount, mesh.index);
+        
+        logMessage(LOG_INFO, LOG_RESOURCE, "compressed sphere: vertex {} -> {} bytes, index {} -> {} bytes",
+                   mesh.vertexcount * sizeof(Object::Vertex), mesh.vertex.size(), mesh.indexcount * sizeof(GLuint), mesh.index.size());
+        
+        shape.reset(new SolidShapeIndex(3, mesh));
+    } else {
+        shape.reset(new SolidShapeIndex(3,
+           static_cast<GLsizei>(solidSphereVertex.size()), solidSphereVertex.data(),
+           static_cast<GLsizei>(solidSphereIndex.size()), solidSphereIndex.data()));
+    }
 
+    // y 軸に沿って tubeJoints 個の関節でつながった円柱
+    static constexpr int tubeJoints(4), tubeSlices(16), tubeStacks(24);
+    static constexpr GLfloat tubeStep(2.0f / (tubeJoints - 1));
+    
+    std::vector<SkinnedShape::Vertex> tubeVertex;
+    tubeVertex.reserve((tubeStacks + 1) * (tubeSlices + 1));
+    
+    for (int j = 0; j <= tubeStacks; ++j) {
+        const float y(2.0f * static_cast<float>(j) / static_cast<float>(tubeStacks) - 1.0f);
+        
+        // 下の関節からの距離で二つの関節に重みを振り分ける
+        const float f((y + 1.0f) / tubeStep);
+        const int j0(std::min(static_cast<int>(f), tubeJoints - 2));
+        const GLubyte w1(static_cast<GLubyte>(std::min(f - static_cast<float>(j0), 1.0f) * 255.0f));
+        
+        for (int i = 0; i <= tubeSlices; ++i) {
+            const float s(static_cast<float>(i) / static_cast<float>(tubeSlices));
+            const float z(cos(2.0f * 3.141593f * s)), x(sin(2.0f * 3.141593f * s));
+            
+            const SkinnedShape::Vertex v = {
+                { 0.3f * x, y, 0.3f * z }, { x, 0.0f, z },
+                { static_cast<GLubyte>(j0), static_cast<GLubyte>(j0 + 1), 0, 0 },
+                { static_cast<GLubyte>(255 - w1), w1, 0, 0 }
+            };
+            tubeVertex.emplace_back(v);
+        }
+    }
+    
+    std::vector<GLuint> tubeIndex;
+    tubeIndex.reserve(tubeStacks * tubeSlices * 6);
+    
+    for (int j = 0; j < tubeStacks; ++j) {
+        const int k((tubeSlices + 1) * j);
+        
+        for (int i = 0; i < tubeSlices; ++i) {
+            const GLuint k0(k + i);
+            const GLuint k1(k0 + 1);
+            const GLuint k2(k1 + tubeSlices);
+            const GLuint k3(k2 + 1);
+            
+            tubeIndex.emplace_back(k0);
+            tubeIndex.emplace_back(k2);
+            tubeIndex.emplace_back(k3);
+            
+            tubeIndex.emplace_back(k0);
+            tubeIndex.emplace_back(k3);
+            tubeIndex.emplace_back(k1);
+        }
+    }
+    
+    const SkinnedShape tube(static_cast<GLsizei>(tubeVertex.size()), tubeVertex.data(),
+        static_cast<GLsizei>(tubeIndex.size()), tubeIndex.data());
+    
+    int tubeParent[tubeJoints];
+    Matrix tubeInverseBind[tubeJoints];
+    GLfloat tubeTranslation[3][tubeJoints][3];
+    Quaternion tubeRotation[3][tubeJoints];
+    static constexpr GLfloat tubeTime[] = { 0.0f, 1.0f, 2.0f };
+    static constexpr GLfloat tubeBend[] = { -0.4f, 0.4f, -0.4f };
+    
+    for (int i = 0; i < tubeJoints; ++i) {
+        tubeParent[i] = i - 1;
+        tubeInverseBind[i] = Matrix::translate(0.0f, 1.0f - tubeStep * i, 0.0f);
+        
+        for (int k = 0; k < 3; ++k) {
+            tubeTranslation[k][i][0] = 0.0f;
+            tubeTranslation[k][i][1] = i == 0 ? -1.0f : tubeStep;
+            tubeTranslation[k][i][2] = 0.0f;
+            tubeRotation[k][i] = Quaternion::rotate(i == 0 ? 0.0f : tubeBend[k], 0.0f, 0.0f, 1.0f);
+        }
+    }
+    
+    const Skeleton tubeSkeleton(tubeJoints, tubeParent, tubeInverseBind);
+    const Animation tubeAnimation(tubeJoints, 3, tubeTime, tubeTranslation[0][0], tubeRotation[0]);
+    
+    SkinnedShape::Palette tubePalette;
+    const Uniform<SkinnedShape::Palette> palette(&tubePalette);
+    
+    ThreadPool pool;
+    
+    // 右ボタンで指した球と三角形を GPU から読み戻さずに求める
+    const TriangleBVH sphereBVH(solidSphereVertex.data(), static_cast<GLsizei>(solidSphereIndex.size()), solidSphereIndex.data(), &pool);
+    Picker picker;
+    picker.add(sphereBVH, Matrix::identity());
+    picker.add(sphereBVH, Matrix::identity());
+    Hit picked(Hit::none());
+    
+    static constexpr ParticleParameters particleParameters = {
+        {
+            { { -1.5f, 1.0f, 0.0f }, 2.0f },
+            { { 1.5f, 1.0f, 0.0f }, 3.0f }
+        },
+        2,
+        { 0.0f, -2.0f, 0.0f },
+        0.2f,
+        3.0f
+    };
+    static constexpr Color particleColor = { 1.0f, 0.4f, 0.1f };
+    
+    std::unique_ptr<ParticleSystem> particleSystem;
+    std::unique_ptr<ParticleSimulator> particleSimulator;
+    if (particles != NULL && particleCount > 0) {
+        particleSystem.reset(new ParticleSystem(particleCount, particleParameters));
+        if (strcmp(particles, "cpu") == 0) {
+            particleSimulator.reset(new ParticleSimulator(particleCount, particleParameters));
+        }
+    }
+    
+    // 点群は原点を中心に一辺 4 の立方体に収める
+    std::unique_ptr<PointCloud> pointCloud;
+    Matrix pointCloudModel(Matrix::identity());
+    if (pointCloudDirectory != NULL) {
+        pointCloud.reset(new PointCloud(pointCloudDirectory));
+        if (const PointCloud::Node *const root = pointCloud->root()) {
+            const GLfloat s(4.0f / root->size);
+            const GLfloat h(root->size * 0.5f);
+            pointCloudModel = Matrix::scale(s, s, s) * Matrix::translate(-root->min[0] - h, -root->min[1] - h, -root->min[2] - h);
+        }
+    }
+    
     static constexpr int Lcount(2);
     static constexpr Vector Lpos[] = {0.0f, 0.0f, 5.0f, 1.0f, 8.0f, 0.0f, 0.0f, 1.0f};
-    static constexpr GLfloat Lamb[] = {0.2f, 0.1f, 0.1f, 0.1f, 0.1f, 0.1f};
-    static constexpr GLfloat Ldiff[] = {1.0f, 0.5f, 0.5f, 0.9f, 0.9f, 0.9f};
-    static constexpr GLfloat Lspec[] = {1.0f, 0.5f, 0.5f, 0.9f, 0.9f, 0.9f};
+    static constexpr Color Lamb[] = {0.2f, 0.1f, 0.1f, 0.1f, 0.1f, 0.1f};
+    static constexpr Color Ldiff[] = {1.0f, 0.5f, 0.5f, 0.9f, 0.9f, 0.9f};
+    static constexpr Color Lspec[] = {1.0f, 0.5f, 0.5f, 0.9f, 0.9f, 0.9f};
     static constexpr Material color[] = {
         // Kamb             Kdiff             Kspec             Kshi
         { 0.6f, 0.6f, 0.2f, 0.6f, 0.6f, 0.2f, 0.3f, 0.3f, 0.3f, 30.0f },
@@ -216,54 +480,212 @@ int main(int argc, const char * argv[]) {
     };
     
     const Uniform<Material> material(color, 2);
+    
+    // 視点と光源の位置は変わらないのでコンパイル時に求めておく
+    static constexpr Matrix view(Matrix::lookat(3.0f, 4.0f, 5.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f));
+    static constexpr Vector LposView[] = { view * Lpos[0], view * Lpos[1] };
+    static constexpr Matrix offset(Matrix::translate(0.0f, 0.0f, 3.0f));
+    static constexpr Matrix tubeOffset(Matrix::translate(0.0f, 0.0f, -3.0f));
 
+    std::unique_ptr<FrameCapture> capture;
+    if (captureFormat != NULL) {
+        capture.reset(new FrameCapture(capturePath, strcmp(captureFormat, "yuv") == 0 ? FrameCapture::YUV : FrameCapture::PNG));
+    }
+    
     glfwSetTime(0.0);
+    double nextReport(5.0);
+    
+    // 粒子を前に進めた時刻. 時計を戻してから読む
+    double particleTime(glfwGetTime());
+    
+    // 前の報告からのフレームの時間の合計と最大
+    FramePacer::Timing timingSum = {}, timingMax = {};
+    unsigned long timingFrames(0);
+    
+    Simulation simulation(window);
+    
+#ifdef CHECK_FRAME_ALLOCATIONS
+    // 立ち上がりの数フレームが済んだら, フレームの中でヒープを使っていないか確かめる
+    unsigned long frameCount(0);
+#endif
     
     while (window) {
+        FrameArena::beginFrame();
+        
+#ifdef CHECK_FRAME_ALLOCATIONS
+        const size_t allocations(allocationCount());
+#endif
+        
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glUseProgram(program);
+        program.use();
+        
+        const Simulation::State state(simulation.snapshot(glfwGetTime()));
         
         const GLfloat *const size(window.getSize());
-        const GLfloat fovy(window.getScale() * 0.01f);
+        const GLfloat fovy(state.scale * 0.01f);
         const GLfloat aspect(size[0] / size[1]);
         const Matrix projection(Matrix::perspective(fovy, aspect, 1.0f, 10.0f));
 
-        const GLfloat *const location(window.getLocation());
-        const Matrix r(Matrix::rotate(static_cast<GLfloat>(glfwGetTime()), 0.0f, 1.0f, 0.0f));
-        const Matrix model(Matrix::translate(location[0], location[1], 0.0f) * r);
-        
-        const Matrix view(Matrix::lookat(3.0f, 4.0f, 5.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f));
+        const GLfloat *const location(state.location);
+        const Matrix r(Matrix::rotate(state.angle, 0.0f, 1.0f, 0.0f));
         
-        GLfloat normalMatrix[9];
+        NormalMatrix normalMatrix;
         
+        const Matrix model(Matrix::translate(location[0], location[1], 0.0f) * r);
         const Matrix modelview(view * model);
-        modelview.getNormalMatrix(normalMatrix);
+        modelview.getNormalMatrix(normalMatrix.data());
         
-        glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, projection.data());
-        glUniformMatrix4fv(modelViewLoc, 1, GL_FALSE, modelview.data());
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, normalMatrix);
-
-        for (int i = 0; i < Lcount; ++i) {
-            glUniform4fv(LposLoc+i, 1, (view * Lpos[i]).data());
+        // 前のフレームと同じ値はドライバに送られない
+        program.set(projectionLoc, projection);
+        program.set(modelViewLoc, modelview);
+        program.set(normalMatrixLoc, normalMatrix);
+        program.set(LposLoc, LposView, Lcount);
+        program.set(LambLoc, Lamb, Lcount);
+        program.set(LdiffLoc, Ldiff, Lcount);
+        program.set(LspecLoc, Lspec, Lcount);
+        
+        GLfloat cursor[2];
+        if (window.getPickCursor(cursor)) {
+            // 球が前のフレームから動いていなければ build() は何もしない
+            picker.setModel(0, model);
+            picker.setModel(1, model * offset);
+            picker.build();
+            
+            Hit hit;
+            if (!picker.pick(Ray::fromCursor(projection, view, cursor[0], cursor[1]), hit)) {
+                // 外れたら 2 画素ずらした 4 本の光線をまとめて辿り, 一番近い当たりを使う
+                const GLfloat dx(4.0f / size[0]), dy(4.0f / size[1]);
+                const Ray rays[4] = {
+                    Ray::fromCursor(projection, view, cursor[0] - dx, cursor[1]), Ray::fromCursor(projection, view, cursor[0] + dx, cursor[1]),
+                    Ray::fromCursor(projection, view, cursor[0], cursor[1] - dy), Ray::fromCursor(projection, view, cursor[0], cursor[1] + dy)
+                };
+                Hit hits[4];
+                const int mask(picker.pick(rays, hits));
+                for (int k = 0; k < 4; ++k) {
+                    if ((mask & (1 << k)) && hits[k].t < hit.t) {
+                        hit = hits[k];
+                    }
+                }
+            }
+            
+            if (hit.instance != picked.instance || hit.triangle != picked.triangle) {
+                if (hit.instance >= 0) {
+                    logMessage(LOG_INFO, LOG_GENERAL, "picked sphere {} triangle {} at t = {}", hit.instance, hit.triangle, hit.t);
+                }
+                picked = hit;
+            }
         }
-        glUniform3fv(LambLoc, Lcount, Lamb);
-        glUniform3fv(LdiffLoc, Lcount, Ldiff);
-        glUniform3fv(LspecLoc, Lcount, Lspec);
         
         material.select(0, 0);
         shape->draw();
         
-        const Matrix modelview1(modelview * Matrix::translate(0.0f, 0.0f, 3.0f));
+        const Matrix modelview1(modelview * offset);
         
-        modelview1.getNormalMatrix(normalMatrix);
+        modelview1.getNormalMatrix(normalMatrix.data());
         
-        glUniformMatrix4fv(modelViewLoc, 1, GL_FALSE, modelview1.data());
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, normalMatrix);
+        program.set(modelViewLoc, modelview1);
+        program.set(normalMatrixLoc, normalMatrix);
         
         material.select(0, 1);
         shape->draw();
         
-        window.swapBuffers();
+        if (skinning != NULL) {
+            std::vector<Matrix, ArenaAllocator<Matrix>> transform(tubeSkeleton.size());
+            tubeAnimation.sample(state.angle, transform.data());
+            tubeSkeleton.pose(transform.data(), tubePalette.joint);
+            
+            const Matrix modelview2(modelview * tubeOffset);
+            modelview2.getNormalMatrix(normalMatrix.data());
+            
+            material.select(0, 0);
+            
+            if (strcmp(skinning, "gpu") == 0) {
+                skinProgram.use();
+                
+                skinProgram.set(skinProjectionLoc, projection);
+                skinProgram.set(skinModelViewLoc, modelview2);
+                skinProgram.set(skinNormalMatrixLoc, normalMatrix);
+                skinProgram.set(skinLposLoc, LposView, Lcount);
+                skinProgram.set(skinLambLoc, Lamb, Lcount);
+                skinProgram.set(skinLdiffLoc, Ldiff, Lcount);
+                skinProgram.set(skinLspecLoc, Lspec, Lcount);
+                
+                palette.set(&tubePalette);
+                palette.select(1);
+                tube.draw();
+            } else {
+                program.set(modelViewLoc, modelview2);
+                program.set(normalMatrixLoc, normalMatrix);
+                
+                tube.draw(tubePalette.joint, pool);
+            }
+        }
+        
+        if (particleSystem) {
+            const double now(glfwGetTime());
+            const GLfloat dt(static_cast<GLfloat>(std::min(now - particleTime, 0.1)));
+            particleTime = now;
+            
+            if (particleSimulator) {
+                particleSystem->step(particleParameters, dt, *particleSimulator, pool);
+            } else {
+                particleSystem->step(particleParameters, dt);
+            }
+            particleSystem->draw(projection, view, particleParameters, 40.0f, particleColor);
+        }
+        
+        if (pointCloud) {
+            const Matrix modelview3(modelview * pointCloudModel);
+            pointCloud->update(projection, modelview3, size[1]);
+            pointCloud->draw(projection, modelview3, size[1]);
+        }
+        
+        if (capture) {
+            capture->capture();
+        }
+        
+        window.swapBuffers(state.inputTime);
+        
+        if (timingReport) {
+            const FramePacer::Timing &t(window.getTiming());
+            timingSum.cpu += t.cpu;
+            timingSum.gpu += t.gpu;
+            timingSum.present += t.present;
+            timingSum.latency += t.latency;
+            timingMax.cpu = std::max(timingMax.cpu, t.cpu);
+            timingMax.gpu = std::max(timingMax.gpu, t.gpu);
+            timingMax.present = std::max(timingMax.present, t.present);
+            timingMax.latency = std::max(timingMax.latency, t.latency);
+            ++timingFrames;
+        }
+        
+        if ((memoryReport || timingReport) && glfwGetTime() >= nextReport) {
+            if (timingReport && timingFrames > 0) {
+                const double n(1000.0 / static_cast<double>(timingFrames));
+                logMessage(LOG_INFO, LOG_WINDOW, "{} frames: cpu {} ms (max {}), gpu {} ms (max {}), present {} ms (max {}), latency {} ms (max {})",
+                           timingFrames, timingSum.cpu * n, timingMax.cpu * 1000.0, timingSum.gpu * n, timingMax.gpu * 1000.0,
+                           timingSum.present * n, timingMax.present * 1000.0, timingSum.latency * n, timingMax.latency * 1000.0);
+                timingSum = timingMax = FramePacer::Timing();
+                timingFrames = 0;
+            }
+            if (memoryReport) {
+                ResourcePool::instance().logReport();
+            }
+            nextReport += 5.0;
+        }
+        
+        if (capture && captureFrames > 0 && capture->getCounters().captured >= captureFrames) {
+            break;
+        }
+        
+#ifdef CHECK_FRAME_ALLOCATIONS
+        if (++frameCount > 60 && allocationCount() != allocations) {
+            logMessage(LOG_WARNING, LOG_GENERAL, "frame {}: {} heap allocations (arena peak {} bytes)",
+                       frameCount, allocationCount() - allocations, FrameArena::local().getPeak());
+        }
+#endif
     }
+    
+    stopTrace();
 }
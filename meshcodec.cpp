@@ -0,0 +1,416 @@
+#include "meshcodec.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+    constexpr unsigned char indexMagic = 0xe1;
+    constexpr unsigned char vertexMagic = 0xa1;
+    
+    // 三角形の符号の下位 4 ビット. 0 から 8 は直前の三角形の辺 (code / 3) を共有し, code % 3 だけ回っている
+    constexpr unsigned char freshTriangle = 9;
+    
+    // 頂点はこの数ずつまとめて並べ替える
+    constexpr size_t vertexBlock = 256;
+    
+    // 差分はこの数ずつ同じビット数に詰める
+    constexpr size_t group = 16;
+    
+    void writeVarint(std::vector<unsigned char> &out, uint32_t v){
+        while (v >= 0x80) {
+            out.push_back(static_cast<unsigned char>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<unsigned char>(v));
+    }
+    
+    bool readVarint(const unsigned char *&p, const unsigned char *end, uint32_t &v){
+        v = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (p == end) {
+                return false;
+            }
+            
+            const unsigned char b(*p++);
+            v |= static_cast<uint32_t>(b & 0x7f) << shift;
+            if ((b & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    // 前の頂点番号との差を符号なしの小さな数にする
+    uint32_t zigzag(GLuint v, GLuint last){
+        const int32_t d(static_cast<int32_t>(v - last));
+        return (static_cast<uint32_t>(d) << 1) ^ static_cast<uint32_t>(d >> 31);
+    }
+    
+    GLuint unzigzag(uint32_t z, GLuint last){
+        return last + ((z >> 1) ^ (0u - (z & 1)));
+    }
+    
+    // 指標の符号化と復号で同じように進める状態
+    struct IndexState{
+        // 直前の三角形
+        GLuint previous[3];
+        bool hasPrevious;
+        
+        // 次に初めて現れると予測する頂点番号
+        GLuint next;
+        
+        // 最後に符号化した頂点番号
+        GLuint last;
+    };
+    
+    // 予測が当たれば true を返し, 外れれば差分を書く
+    bool encodeVertexIndex(IndexState &s, GLuint v, std::vector<unsigned char> &data){
+        const bool predicted(v == s.next);
+        if (predicted) {
+            ++s.next;
+        } else {
+            writeVarint(data, zigzag(v, s.last));
+        }
+        s.last = v;
+        return predicted;
+    }
+    
+    bool decodeVertexIndex(IndexState &s, bool predicted, const unsigned char *&p, const unsigned char *end, GLuint &v){
+        if (predicted) {
+            v = s.next++;
+        } else {
+            uint32_t z;
+            if (!readVarint(p, end, z)) {
+                return false;
+            }
+            v = unzigzag(z, s.last);
+        }
+        s.last = v;
+        return true;
+    }
+    
+    unsigned char byteZigzag(unsigned char d){
+        const signed char s(static_cast<signed char>(d));
+        return static_cast<unsigned char>((static_cast<unsigned int>(d) << 1) ^ static_cast<unsigned int>(s >> 7));
+    }
+    
+    // 16 個の値を詰めるビット数の番号 (0, 2, 4, 8 ビット)
+    int groupMode(const unsigned char *z){
+        const unsigned char m(*std::max_element(z, z + group));
+        return m == 0 ? 0 : m < 4 ? 1 : m < 16 ? 2 : 3;
+    }
+    
+    constexpr size_t groupBytes[4] = { 0, group / 4, group / 2, group };
+    
+    void packGroup(const unsigned char *z, int mode, std::vector<unsigned char> &out){
+        switch (mode) {
+            case 1:
+                for (size_t j = 0; j < group; j += 4) {
+                    out.push_back(static_cast<unsigned char>(z[j] << 6 | z[j + 1] << 4 | z[j + 2] << 2 | z[j + 3]));
+                }
+                break;
+            case 2:
+                for (size_t j = 0; j < group; j += 2) {
+                    out.push_back(static_cast<unsigned char>(z[j] << 4 | z[j + 1]));
+                }
+                break;
+            case 3:
+                out.insert(out.end(), z, z + group);
+                break;
+        }
+    }
+
+#if defined(__SSE2__)
+    // 詰めた 16 個の差分を戻し, carry から順に足して値にする
+    unsigned char unpackGroup(const unsigned char *p, int mode, unsigned char carry, unsigned char *out){
+        const __m128i low2(_mm_set1_epi8(0x03));
+        const __m128i low4(_mm_set1_epi8(0x0f));
+        __m128i z;
+        
+        switch (mode) {
+            case 0:
+                z = _mm_setzero_si128();
+                break;
+            case 1:{
+                int32_t packed;
+                std::memcpy(&packed, p, sizeof packed);
+                const __m128i b(_mm_cvtsi32_si128(packed));
+                const __m128i a(_mm_and_si128(_mm_srli_epi16(b, 6), low2));
+                const __m128i c(_mm_and_si128(_mm_srli_epi16(b, 4), low2));
+                const __m128i d(_mm_and_si128(_mm_srli_epi16(b, 2), low2));
+                const __m128i e(_mm_and_si128(b, low2));
+                z = _mm_unpacklo_epi16(_mm_unpacklo_epi8(a, c), _mm_unpacklo_epi8(d, e));
+                break;
+            }
+            case 2:{
+                const __m128i b(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+                z = _mm_unpacklo_epi8(_mm_and_si128(_mm_srli_epi16(b, 4), low4), _mm_and_si128(b, low4));
+                break;
+            }
+            default:
+                z = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+                break;
+        }
+        
+        // (z >> 1) ^ -(z & 1)
+        const __m128i one(_mm_set1_epi8(1));
+        const __m128i half(_mm_and_si128(_mm_srli_epi16(z, 1), _mm_set1_epi8(0x7f)));
+        __m128i x(_mm_xor_si128(half, _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(z, one))));
+        
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 1));
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 2));
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi8(x, _mm_set1_epi8(static_cast<char>(carry)));
+        
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), x);
+        return out[group - 1];
+    }
+#else
+    unsigned char byteUnzigzag(unsigned char z){
+        return static_cast<unsigned char>((z >> 1) ^ (0u - (z & 1)));
+    }
+    
+    unsigned char unpackGroup(const unsigned char *p, int mode, unsigned char carry, unsigned char *out){
+        for (size_t j = 0; j < group; ++j) {
+            unsigned char z(0);
+            switch (mode) {
+                case 1: z = (p[j / 4] >> (6 - 2 * (j % 4))) & 0x03; break;
+                case 2: z = (p[j / 2] >> (4 - 4 * (j % 2))) & 0x0f; break;
+                case 3: z = p[j]; break;
+            }
+            carry = static_cast<unsigned char>(carry + byteUnzigzag(z));
+            out[j] = carry;
+        }
+        return carry;
+    }
+#endif
+    
+    // バイトごとの並び channel から頂点の並びに戻す
+    void interleave(const unsigned char *channel, size_t count, size_t stride, unsigned char *vertex){
+        size_t k(0);
+
+#if defined(__SSE2__)
+        // 4 バイトずつ 16 頂点をまとめて組み直す
+        for (; k + 4 <= stride; k += 4) {
+            const unsigned char *const c(channel + k * vertexBlock);
+            for (size_t i = 0; i < count; i += 16) {
+                const __m128i c0(_mm_loadu_si128(reinterpret_cast<const __m128i *>(c + i)));
+                const __m128i c1(_mm_loadu_si128(reinterpret_cast<const __m128i *>(c + vertexBlock + i)));
+                const __m128i c2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(c + 2 * vertexBlock + i)));
+                const __m128i c3(_mm_loadu_si128(reinterpret_cast<const __m128i *>(c + 3 * vertexBlock + i)));
+                
+                const __m128i lo01(_mm_unpacklo_epi8(c0, c1)), hi01(_mm_unpackhi_epi8(c0, c1));
+                const __m128i lo23(_mm_unpacklo_epi8(c2, c3)), hi23(_mm_unpackhi_epi8(c2, c3));
+                const __m128i word[4] = {
+                    _mm_unpacklo_epi16(lo01, lo23), _mm_unpackhi_epi16(lo01, lo23),
+                    _mm_unpacklo_epi16(hi01, hi23), _mm_unpackhi_epi16(hi01, hi23)
+                };
+                
+                alignas(16) int32_t w[16];
+                for (int j = 0; j < 4; ++j) {
+                    _mm_store_si128(reinterpret_cast<__m128i *>(w + 4 * j), word[j]);
+                }
+                
+                const size_t n(std::min<size_t>(16, count - i));
+                for (size_t j = 0; j < n; ++j) {
+                    std::memcpy(vertex + (i + j) * stride + k, w + j, 4);
+                }
+            }
+        }
+#endif
+        
+        for (; k < stride; ++k) {
+            const unsigned char *const c(channel + k * vertexBlock);
+            for (size_t i = 0; i < count; ++i) {
+                vertex[i * stride + k] = c[i];
+            }
+        }
+    }
+}
+
+void encodeIndexBuffer(const GLuint *index, GLsizei count, std::vector<unsigned char> &out){
+    const size_t triangles(static_cast<size_t>(count) / 3);
+    
+    std::vector<unsigned char> codes;
+    codes.reserve(triangles);
+    std::vector<unsigned char> data;
+    
+    IndexState s = {};
+    
+    for (size_t i = 0; i < triangles; ++i) {
+        const GLuint *const t(index + 3 * i);
+        unsigned char code(freshTriangle);
+        
+        // 向きをそろえた隣の三角形は直前の三角形の辺を逆向きに持つ
+        if (s.hasPrevious) {
+            for (int e = 0; e < 3 && code == freshTriangle; ++e) {
+                for (int r = 0; r < 3; ++r) {
+                    if (t[r] == s.previous[(e + 1) % 3] && t[(r + 1) % 3] == s.previous[e]) {
+                        code = static_cast<unsigned char>(e * 3 + r);
+                        break;
+                    }
+                }
+            }
+        }
+        
+        if (code == freshTriangle) {
+            for (int j = 0; j < 3; ++j) {
+                if (encodeVertexIndex(s, t[j], data)) {
+                    code |= 0x10 << j;
+                }
+            }
+        } else if (encodeVertexIndex(s, t[(code % 3 + 2) % 3], data)) {
+            code |= 0x10;
+        }
+        
+        codes.push_back(code);
+        std::copy(t, t + 3, s.previous);
+        s.hasPrevious = true;
+    }
+    
+    // 三角形にならない余りはそのまま差分で書く
+    for (size_t i = triangles * 3; i < static_cast<size_t>(count); ++i) {
+        writeVarint(data, zigzag(index[i], s.last));
+        s.last = index[i];
+    }
+    
+    out.clear();
+    out.reserve(1 + codes.size() + data.size());
+    out.push_back(indexMagic);
+    out.insert(out.end(), codes.begin(), codes.end());
+    out.insert(out.end(), data.begin(), data.end());
+}
+
+bool decodeIndexBuffer(const unsigned char *data, size_t size, GLuint *index, GLsizei count){
+    const size_t triangles(static_cast<size_t>(count) / 3);
+    if (size < 1 + triangles || data[0] != indexMagic) {
+        return false;
+    }
+    
+    const unsigned char *codes(data + 1);
+    const unsigned char *p(codes + triangles);
+    const unsigned char *const end(data + size);
+    
+    IndexState s = {};
+    
+    for (size_t i = 0; i < triangles; ++i) {
+        const unsigned char code(codes[i]);
+        const unsigned char c(code & 0x0f);
+        GLuint *const t(index + 3 * i);
+        
+        if (c == freshTriangle) {
+            for (int j = 0; j < 3; ++j) {
+                if (!decodeVertexIndex(s, (code & (0x10 << j)) != 0, p, end, t[j])) {
+                    return false;
+                }
+            }
+        } else if (c < freshTriangle && s.hasPrevious) {
+            const int e(c / 3), r(c % 3);
+            t[r] = s.previous[(e + 1) % 3];
+            t[(r + 1) % 3] = s.previous[e];
+            if (!decodeVertexIndex(s, (code & 0x10) != 0, p, end, t[(r + 2) % 3])) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+        
+        std::copy(t, t + 3, s.previous);
+        s.hasPrevious = true;
+    }
+    
+    for (size_t i = triangles * 3; i < static_cast<size_t>(count); ++i) {
+        uint32_t z;
+        if (!readVarint(p, end, z)) {
+            return false;
+        }
+        index[i] = s.last = unzigzag(z, s.last);
+    }
+    
+    return p == end;
+}
+
+void encodeVertexBuffer(const void *vertex, GLsizei count, size_t stride, std::vector<unsigned char> &out){
+    const unsigned char *const v(static_cast<const unsigned char *>(vertex));
+    
+    out.clear();
+    out.push_back(vertexMagic);
+    
+    std::vector<unsigned char> previous(stride, 0);
+    unsigned char z[vertexBlock];
+    
+    for (size_t base = 0; base < static_cast<size_t>(count); base += vertexBlock) {
+        const size_t n(std::min(vertexBlock, static_cast<size_t>(count) - base));
+        const size_t groups((n + group - 1) / group);
+        
+        for (size_t k = 0; k < stride; ++k) {
+            // 余りは差分 0 で埋める
+            std::fill(z, z + groups * group, 0);
+            
+            unsigned char last(previous[k]);
+            for (size_t i = 0; i < n; ++i) {
+                const unsigned char b(v[(base + i) * stride + k]);
+                z[i] = byteZigzag(static_cast<unsigned char>(b - last));
+                last = b;
+            }
+            previous[k] = last;
+            
+            // 4 グループ分のビット数を 1 バイトにまとめて先に書く
+            const size_t header(out.size());
+            out.resize(header + (groups + 3) / 4, 0);
+            
+            for (size_t g = 0; g < groups; ++g) {
+                const int mode(groupMode(z + g * group));
+                out[header + g / 4] |= static_cast<unsigned char>(mode << (2 * (g % 4)));
+                packGroup(z + g * group, mode, out);
+            }
+        }
+    }
+}
+
+bool decodeVertexBuffer(const unsigned char *data, size_t size, void *vertex, GLsizei count, size_t stride){
+    if (size < 1 || data[0] != vertexMagic) {
+        return false;
+    }
+    
+    const unsigned char *p(data + 1);
+    const unsigned char *const end(data + size);
+    unsigned char *const v(static_cast<unsigned char *>(vertex));
+    
+    std::vector<unsigned char> channel(stride * vertexBlock);
+    std::vector<unsigned char> previous(stride, 0);
+    
+    for (size_t base = 0; base < static_cast<size_t>(count); base += vertexBlock) {
+        const size_t n(std::min(vertexBlock, static_cast<size_t>(count) - base));
+        const size_t groups((n + group - 1) / group);
+        
+        for (size_t k = 0; k < stride; ++k) {
+            const size_t headerBytes((groups + 3) / 4);
+            if (static_cast<size_t>(end - p) < headerBytes) {
+                return false;
+            }
+            const unsigned char *const header(p);
+            p += headerBytes;
+            
+            unsigned char carry(previous[k]);
+            for (size_t g = 0; g < groups; ++g) {
+                const int mode((header[g / 4] >> (2 * (g % 4))) & 0x03);
+                if (static_cast<size_t>(end - p) < groupBytes[mode]) {
+                    return false;
+                }
+                
+                carry = unpackGroup(p, mode, carry, &channel[k * vertexBlock + g * group]);
+                p += groupBytes[mode];
+            }
+            previous[k] = carry;
+        }
+        
+        interleave(channel.data(), n, stride, v + base * stride);
+    }
+    
+    return p == end;
+}
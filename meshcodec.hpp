@@ -0,0 +1,24 @@
+#ifndef meshcodec_hpp
+#define meshcodec_hpp
+
+#include <cstddef>
+#include <vector>
+#include <GL/glew.h>
+
+// 圧縮した頂点と指標. Object はこれを割り当てたバッファに直接展開する
+struct EncodedMesh{
+    GLsizei vertexcount;
+    std::vector<unsigned char> vertex;
+    GLsizei indexcount;
+    std::vector<unsigned char> index;
+};
+
+// 三角形ごとに直前の三角形と共有する辺を予測し, 残りの頂点番号を差分の可変長整数にする
+void encodeIndexBuffer(const GLuint *index, GLsizei count, std::vector<unsigned char> &out);
+bool decodeIndexBuffer(const unsigned char *data, size_t size, GLuint *index, GLsizei count);
+
+// 頂点をバイトごとに並べ替えて直前の頂点との差分をとり, 16 個ずつ 0/2/4/8 ビットに詰める
+void encodeVertexBuffer(const void *vertex, GLsizei count, size_t stride, std::vector<unsigned char> &out);
+bool decodeVertexBuffer(const unsigned char *data, size_t size, void *vertex, GLsizei count, size_t stride);
+
+#endif /* meshcodec_hpp */
@@ -0,0 +1,11 @@
+#version 150 core
+uniform vec3 color;
+in float fade;
+out vec4 fragment;
+void main()
+{
+    vec2 c = gl_PointCoord * 2.0 - 1.0;
+    float r = dot(c, c);
+    if (r > 1.0) discard;
+    fragment = vec4(color, fade * (1.0 - r));
+}
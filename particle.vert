@@ -0,0 +1,16 @@
+#version 150 core
+uniform mat4 modelview;
+uniform mat4 projection;
+uniform float lifetime;
+uniform float pointSize;
+in vec4 position;
+in vec4 velocity;
+out float fade;
+void main()
+{
+    vec4 p = modelview * vec4(position.xyz, 1.0);
+    fade = 1.0 - position.w / lifetime;
+    // まだ生まれていない粒子はクリッピングで捨てる
+    gl_Position = position.w < 0.0 ? vec4(0.0, 0.0, 2.0, 1.0) : projection * p;
+    gl_PointSize = pointSize * velocity.w / max(-p.z, 0.1);
+}
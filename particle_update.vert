@@ -0,0 +1,39 @@
+#version 150 core
+const int maxEmitters = 4;
+uniform float dt;
+uniform float lifetime;
+uniform float drag;
+uniform vec3 gravity;
+uniform vec4 emitter[maxEmitters];
+uniform int emitterCount;
+uniform int frame;
+in vec4 position;
+in vec4 velocity;
+out vec4 nextPosition;
+out vec4 nextVelocity;
+float random(uint x)
+{
+    x ^= x >> 16u;
+    x *= 0x7feb352du;
+    x ^= x >> 15u;
+    x *= 0x846ca68bu;
+    x ^= x >> 16u;
+    return float(x) * (1.0 / 4294967295.0);
+}
+void main()
+{
+    float age = position.w + dt;
+    nextPosition = vec4(position.xyz, age);
+    nextVelocity = velocity;
+    if (age >= lifetime) {
+        uint seed = uint(gl_VertexID) * 4u + uint(frame) * 2654435761u;
+        vec4 e = emitter[gl_VertexID % emitterCount];
+        vec3 d = vec3(random(seed) * 2.0 - 1.0, random(seed + 1u), random(seed + 2u) * 2.0 - 1.0);
+        nextPosition = vec4(e.xyz, age - lifetime);
+        nextVelocity = vec4(normalize(d + vec3(0.0, 0.5, 0.0)) * e.w, 0.5 + random(seed + 3u));
+    } else if (age >= 0.0) {
+        vec3 v = (velocity.xyz + gravity * dt) * max(1.0 - drag * dt, 0.0);
+        nextPosition.xyz += v * dt;
+        nextVelocity.xyz = v;
+    }
+}
@@ -0,0 +1,195 @@
+#include "pointcloud.hpp"
+#include "log.hpp"
+#include "class/PointCloud.h"
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace {
+    // 一度に読み書きする点の数
+    constexpr size_t batch = 65536;
+    
+    // これより深い節点は分けずに全部持たせる (同じ位置の点が多いとき)
+    constexpr int maxDepth = 20;
+    
+    struct Pending{
+        int node;
+        int depth;
+        std::string file;
+        bool temporary;
+    };
+    
+    size_t countPoints(FILE *file){
+        std::fseek(file, 0L, SEEK_END);
+        const long length(std::ftell(file));
+        std::fseek(file, 0L, SEEK_SET);
+        return length < 0 ? 0 : static_cast<size_t>(length) / sizeof(PointCloud::Point);
+    }
+}
+
+bool buildPointCloud(const char *input, const char *directory, size_t capacity){
+    typedef PointCloud::Point Point;
+    typedef PointCloud::Node Node;
+    
+    FILE *const source(std::fopen(input, "rb"));
+    if (source == NULL) {
+        logMessage(LOG_ERROR, LOG_RESOURCE, "cant open point file: {}", input);
+        return false;
+    }
+    
+    // 全体を囲む立方体を求める
+    GLfloat min[3] = { 1.0e30f, 1.0e30f, 1.0e30f };
+    GLfloat max[3] = { -1.0e30f, -1.0e30f, -1.0e30f };
+    std::vector<Point> buffer(batch);
+    size_t total(0);
+    for (size_t n; (n = std::fread(buffer.data(), sizeof(Point), batch, source)) > 0; total += n) {
+        for (size_t i = 0; i < n; ++i) {
+            for (int k = 0; k < 3; ++k) {
+                min[k] = std::min(min[k], buffer[i].position[k]);
+                max[k] = std::max(max[k], buffer[i].position[k]);
+            }
+        }
+    }
+    std::fclose(source);
+    
+    if (total == 0) {
+        logMessage(LOG_ERROR, LOG_RESOURCE, "no points in: {}", input);
+        return false;
+    }
+    
+    const std::string base(directory);
+    FILE *const points(std::fopen((base + "/points.bin").c_str(), "wb"));
+    if (points == NULL) {
+        logMessage(LOG_ERROR, LOG_RESOURCE, "cant create point cloud data in: {}", directory);
+        return false;
+    }
+    
+    std::vector<Node> nodes(1);
+    Node &root(nodes[0]);
+    std::copy(min, min + 3, root.min);
+    // 端の点が外に出ないように少し大きくする
+    root.size = std::max({ max[0] - min[0], max[1] - min[1], max[2] - min[2], 1.0e-6f }) * 1.0001f;
+    
+    std::deque<Pending> queue;
+    queue.push_back({ 0, 0, input, false });
+    
+    std::vector<Point> sample;
+    std::vector<Point> part[8];
+    uint64_t written(0);
+    bool ok(true);
+    
+    while (ok && !queue.empty()) {
+        const Pending pending(queue.front());
+        queue.pop_front();
+        
+        FILE *const file(std::fopen(pending.file.c_str(), "rb"));
+        if (file == NULL) {
+            logMessage(LOG_ERROR, LOG_RESOURCE, "cant open point file: {}", pending.file);
+            ok = false;
+            break;
+        }
+        
+        const size_t count(countPoints(file));
+        const bool leaf(count <= capacity || pending.depth >= maxDepth);
+        
+        // 葉でなければ count / capacity 個ごとに 1 個を自分の点として残す
+        const size_t stride(leaf ? 1 : (count + capacity - 1) / capacity);
+        
+        Node node(nodes[pending.node]);
+        node.first = written;
+        node.count = 0;
+        std::fill(node.child, node.child + 8, -1);
+        
+        const GLfloat half(node.size * 0.5f);
+        FILE *children[8] = {};
+        
+        size_t index(0);
+        for (size_t n; ok && (n = std::fread(buffer.data(), sizeof(Point), batch, file)) > 0;) {
+            sample.clear();
+            for (int c = 0; c < 8; ++c) {
+                part[c].clear();
+            }
+            
+            for (size_t i = 0; i < n; ++i, ++index) {
+                const Point &p(buffer[i]);
+                if (index % stride == 0) {
+                    sample.push_back(p);
+                    continue;
+                }
+                
+                const int c((p.position[0] >= node.min[0] + half ? 1 : 0)
+                          | (p.position[1] >= node.min[1] + half ? 2 : 0)
+                          | (p.position[2] >= node.min[2] + half ? 4 : 0));
+                part[c].push_back(p);
+            }
+            
+            ok = std::fwrite(sample.data(), sizeof(Point), sample.size(), points) == sample.size();
+            node.count += static_cast<uint32_t>(sample.size());
+            written += sample.size();
+            
+            for (int c = 0; ok && c < 8; ++c) {
+                if (part[c].empty()) {
+                    continue;
+                }
+                
+                if (children[c] == NULL) {
+                    const std::string name(base + "/node" + std::to_string(pending.node) + "_" + std::to_string(c) + ".tmp");
+                    children[c] = std::fopen(name.c_str(), "wb");
+                    if (children[c] == NULL) {
+                        logMessage(LOG_ERROR, LOG_RESOURCE, "cant create temporary file: {}", name);
+                        ok = false;
+                        break;
+                    }
+                    
+                    Node child = {};
+                    child.size = half;
+                    for (int k = 0; k < 3; ++k) {
+                        child.min[k] = node.min[k] + ((c >> k) & 1 ? half : 0.0f);
+                    }
+                    node.child[c] = static_cast<int32_t>(nodes.size());
+                    nodes.push_back(child);
+                    queue.push_back({ node.child[c], pending.depth + 1, name, true });
+                }
+                
+                ok = std::fwrite(part[c].data(), sizeof(Point), part[c].size(), children[c]) == part[c].size();
+            }
+        }
+        
+        std::fclose(file);
+        for (FILE *child : children) {
+            if (child != NULL && std::fclose(child) != 0) {
+                ok = false;
+            }
+        }
+        if (pending.temporary) {
+            std::remove(pending.file.c_str());
+        }
+        
+        nodes[pending.node] = node;
+    }
+    
+    // 途中で失敗したときは残った一時ファイルを消す
+    for (const Pending &pending : queue) {
+        std::remove(pending.file.c_str());
+    }
+    
+    if (std::fclose(points) != 0 || !ok) {
+        logMessage(LOG_ERROR, LOG_RESOURCE, "could not write point cloud data in: {}", directory);
+        return false;
+    }
+    
+    FILE *const hierarchy(std::fopen((base + "/hierarchy.bin").c_str(), "wb"));
+    const uint32_t header[2] = { PointCloud::magic, static_cast<uint32_t>(nodes.size()) };
+    if (hierarchy == NULL
+        || std::fwrite(header, sizeof header, 1, hierarchy) != 1
+        || std::fwrite(nodes.data(), sizeof(Node), nodes.size(), hierarchy) != nodes.size()
+        || std::fclose(hierarchy) != 0) {
+        logMessage(LOG_ERROR, LOG_RESOURCE, "could not write point cloud hierarchy in: {}", directory);
+        return false;
+    }
+    
+    logMessage(LOG_INFO, LOG_RESOURCE, "point cloud: {} points, {} nodes", total, nodes.size());
+    return true;
+}
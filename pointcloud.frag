@@ -0,0 +1,9 @@
+#version 150 core
+in vec3 vertexColor;
+out vec4 fragment;
+void main()
+{
+    vec2 c = gl_PointCoord * 2.0 - 1.0;
+    if (dot(c, c) > 1.0) discard;
+    fragment = vec4(vertexColor, 1.0);
+}
@@ -0,0 +1,11 @@
+#ifndef pointcloud_hpp
+#define pointcloud_hpp
+
+#include <cstddef>
+
+// PointCloud::Point を並べただけのファイル input から directory に八分木を作る
+// 各節点は capacity 個まで間引いた点を持ち, 残りを 8 つの子に分ける
+// 点を全部メモリに読まずに, 節点ごとの一時ファイルを順に分けていく
+bool buildPointCloud(const char *input, const char *directory, size_t capacity = 65536);
+
+#endif /* pointcloud_hpp */
@@ -0,0 +1,16 @@
+#version 150 core
+uniform mat4 modelview;
+uniform mat4 projection;
+uniform float spacing;
+uniform float scale;
+in vec4 position;
+in vec4 color;
+out vec3 vertexColor;
+void main()
+{
+    vec4 p = modelview * position;
+    vertexColor = color.rgb;
+    gl_Position = projection * p;
+    // 節点の点の間隔を画面上の大きさにして隙間を埋める
+    gl_PointSize = clamp(spacing * scale / max(-p.z, 0.001), 1.0, 16.0);
+}
@@ -0,0 +1,22 @@
+#version 150 core
+const int maxJoints = 64;
+uniform mat4 modelview;
+uniform mat4 projection;
+uniform mat3 normalMatrix;
+layout (std140) uniform Palette{
+    mat4 joint[maxJoints];
+};
+in vec4 position;
+in vec3 normal;
+in uvec4 joints;
+in vec4 weights;
+out vec4 P;
+out vec3 N;
+void main()
+{
+    mat4 skin = joint[joints.x] * weights.x + joint[joints.y] * weights.y
+              + joint[joints.z] * weights.z + joint[joints.w] * weights.w;
+    P = modelview * skin * position;
+    N = normalize(normalMatrix * mat3(skin) * normal);
+    gl_Position = projection * P;
+}